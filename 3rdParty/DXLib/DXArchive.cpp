@@ -12,13 +12,21 @@
 
 // include ----------------------------
 #include "DXArchive.h"
+#include "DXArchiveSink.h"
 #include "CharCode.h"
 #include "FileLib.h"
 #include "Huffman.h"
+#include <io.h>
+#include <share.h>
 #include <stdio.h>
 #include <string.h>
 #include <windows.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <thread>
+
 // define -----------------------------
 
 #define MIN_COMPRESS       (4)                     // 最低圧縮バイト数
@@ -28,15 +36,23 @@
 #define MAX_ADDRESSLISTNUM (1024 * 1024 * 1)       // スライド辞書の最大サイズ
 #define MAX_POSITION       (1 << 24)               // 参照可能な最大相対アドレス( 16MB )
 
+#define STREAM_MINSIZE     (0x4000000)                                      // Files of at least this size are extracted with the streaming decoder
+#define STREAM_CHUNKSIZE   (MAX_POSITION)                                   // Output the streaming decoder writes at once
+#define STREAM_WINDOWSIZE  (MAX_POSITION + STREAM_CHUNKSIZE + MAX_COPYSIZE) // History for the back references plus one output chunk
+#define STREAM_INPUTSIZE   (0x100000)                                       // Read buffer for the compressed data
+#define SOURCE_CONVSIZE    (0x10000)                                        // Mapped data is copied and decrypted in pieces of this size while they are in the cache
+
 #define GLOBAL_CHAR_CODE 932
 
-uint8_t g_specialKey[768] = {};
-bool g_newCrypt           = false;
-bool g_chacha20           = false;
-uint16_t g_cryptVersion   = 0;
+// Banner some games put in front of their data files to break unpacking, removed while extracting
+static const uint8_t AntiUnpackData[62] = { 0x45, 0x78, 0x74, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6E, 0x67, 0x20, 0x64, 0x61, 0x74, 0x61, 0x20, 0x66, 0x72, 0x6F, 0x6D, 0x20, 0x65, 0x6E, 0x63, 0x72, 0x79, 0x70, 0x74, 0x65, 0x64, 0x20, 0x66, 0x69, 0x6C, 0x65, 0x73, 0x20, 0x76, 0x69, 0x6F, 0x6C, 0x61, 0x74, 0x65, 0x73, 0x20, 0x74, 0x68, 0x65, 0x20, 0x67, 0x75, 0x69, 0x64, 0x65, 0x6C, 0x69, 0x6E, 0x65, 0x73, 0x2E, 0x00 }; // "Extracting data from encrypted files violates the guidelines."
 
-uint8_t g_cc20Key[32]   = { 0xC9, 0x82, 0xF8, 0xB4, 0x2C, 0x93, 0x9E, 0x83, 0x0E, 0xBC, 0xBC, 0x92, 0x68, 0x8D, 0x59, 0xA1, 0x4A, 0x9E, 0x7F, 0xB0, 0xAC, 0xAF, 0x1D, 0x8F, 0x8E, 0xB8, 0x3B, 0x9E, 0xE8, 0x89, 0xD9, 0xAD };
-uint8_t g_cc20Nonce[12] = { 0xFF, 0xBC, 0x2D, 0xAB, 0x9D, 0x8B, 0x0F, 0xB4, 0xBB, 0x9A, 0x69, 0x85 };
+// Files that can start with the anti-unpack banner
+static const TCHAR *AntiUnpackFileNames[] = { TEXT("game.dat"), TEXT("cdatabase.dat"), TEXT("database.dat"), TEXT("commonevent.dat") };
+
+// Default ChaCha20 key and nonce, used by the ChaCha2 v1 crypt
+static const uint8_t DefaultCC20Key[32]   = { 0xC9, 0x82, 0xF8, 0xB4, 0x2C, 0x93, 0x9E, 0x83, 0x0E, 0xBC, 0xBC, 0x92, 0x68, 0x8D, 0x59, 0xA1, 0x4A, 0x9E, 0x7F, 0xB0, 0xAC, 0xAF, 0x1D, 0x8F, 0x8E, 0xB8, 0x3B, 0x9E, 0xE8, 0x89, 0xD9, 0xAD };
+static const uint8_t DefaultCC20Nonce[12] = { 0xFF, 0xBC, 0x2D, 0xAB, 0x9D, 0x8B, 0x0F, 0xB4, 0xBB, 0x9A, 0x69, 0x85 };
 
 
 
@@ -567,65 +583,105 @@ void DXArchive::KeyCreate(const char *Source, size_t SourceBytes, u8 *Key)
 	}
 }
 
-// 鍵文字列を使用して Xor 演算( Key は必ず DXA_KEY_BYTES の長さがなければならない )
-void DXArchive::KeyConv(void *Data, s64 Size, s64 Position, unsigned char *Key)
+// Set up the crypt context for the given crypt version
+void DXArchive::InitCryptContext(DARC_CRYPTCONTEXT *CryptCtx, uint16_t CryptVersion, const char *KeyString, size_t KeyStringBytes)
 {
-	if (g_newCrypt)
-	{
-		wolf::crypt::wolfCrypt(g_specialKey, reinterpret_cast<uint8_t *>(Data), Position, Position + Size, false, g_cryptVersion);
-		return;
-	}
+	memset(CryptCtx, 0, sizeof(DARC_CRYPTCONTEXT));
 
-	if (g_chacha20)
+	CryptCtx->CryptVersion = CryptVersion;
+	CryptCtx->NewCrypt     = (CryptVersion >= 331 && CryptVersion < 1000 || CryptVersion >= 1010);
+	CryptCtx->ChaCha20     = CryptVersion == 0x64 || CryptVersion == 0xC8;
+
+	std::memcpy(CryptCtx->CC20Key, DefaultCC20Key, sizeof(CryptCtx->CC20Key));
+	std::memcpy(CryptCtx->CC20Nonce, DefaultCC20Nonce, sizeof(CryptCtx->CC20Nonce));
+
+	if (CryptVersion == 0xC8)
 	{
-		uint32_t state[16];
-		uint32_t keystream32[16];
+		std::array<uint8_t, 4> data;
+		std::array<uint8_t, 64> key;
 
-		std::memset(state, 0, sizeof(state));
-		std::memset(keystream32, 0, sizeof(keystream32));
+		std::memcpy(data.data(), (uint8_t *)KeyString + KeyStringBytes + 1, 4);
+		wolf::crypt::chacha20::keySetup(data, key);
 
-		wolf::crypt::chacha20::initBlock(state, g_cc20Key, g_cc20Nonce);
-		wolf::crypt::chacha20::execute(state, keystream32, static_cast<uint32_t>(Position), reinterpret_cast<uint8_t *>(Data), Size);
-		return;
+		std::memcpy(CryptCtx->CC20Key, key.data(), 32);
+		std::memcpy(CryptCtx->CC20Nonce, key.data() + 34, 12);
 	}
+}
 
-	if (Key == NULL)
-	{
-		return;
-	}
+// Set up the layers the v3.31+ crypt puts over the whole archive, a wolfCrypt layer over all data
+// and an AES-CTR layer over the beginning of the data and the compressed header at the end
+void DXArchive::InitArchiveCrypt(DARC_CRYPTCONTEXT *CryptCtx, const DARC_HEAD *Head, const u8 *Pwd, u8 *ProKey, const char *KeyString, s64 ArchiveSize)
+{
+	const uint16_t cryptVersion = CryptCtx->CryptVersion;
+
+	CryptCtx->ArchiveCrypt    = true;
+	CryptCtx->ArchiveKeyStart = sizeof(DARC_HEAD);
+	CryptCtx->ArchiveKeyEnd   = ArchiveSize > (s64)(sizeof(DARC_HEAD) * 2) ? (u64)(ArchiveSize - sizeof(DARC_HEAD)) : sizeof(DARC_HEAD);
+
+	wolf::crypt::initWolfCrypt(cryptVersion, Pwd, CryptCtx->ArchiveKey, nullptr, nullptr, 0, 0, true, KeyString);
+	wolf::crypt::aes::initAES128(CryptCtx->AesRoundKey, Pwd, ProKey, cryptVersion);
 
-	Position %= DXA_KEY_BYTES;
+	// Archives this small have no AES layer
+	CryptCtx->ArchiveAes = (ArchiveSize - (s64)sizeof(DARC_HEAD)) >= 0x400;
+	if (CryptCtx->ArchiveAes == false) return;
 
-	if (Size < 0x100000000)
+	u64 bodySize = 0x400;
+
+	if (wolf::crypt::utils::isV35(cryptVersion))
 	{
-		u32 i, j;
+		uint32_t seed = 0;
 
-		j = (u32)Position;
-		for (i = 0; i < Size; i++)
-		{
-			((u8 *)Data)[i] ^= Key[j];
+		if (cryptVersion >= 1020)
+			seed = ProKey[0] * ProKey[1] + Pwd[2] * Pwd[4] + Pwd[11];
+		else
+			seed = Pwd[2] * Pwd[4] + Pwd[12]; // xorShift32 seed
 
-			j++;
-			if (j == DXA_KEY_BYTES) j = 0;
-		}
+		if (!seed) seed = 1;
+		wolf::crypt::xorshift32(seed);
+
+		if (ArchiveSize >= static_cast<s64>(wolf::crypt::xorshift32() % 500 + 800))
+			wolf::crypt::xorshift32();
+
+		bodySize = (u64)ArchiveSize - sizeof(DARC_HEAD);
+
+		if (bodySize >= (wolf::crypt::xorshift32() % 500 + 800))
+			bodySize = (wolf::crypt::xorshift32() % 500) + 800;
 	}
-	else
+
+	// Both parts use one key stream, the header continues with the block after the body
+	CryptCtx->AesBodyStart   = sizeof(DARC_HEAD);
+	CryptCtx->AesBodyEnd     = sizeof(DARC_HEAD) + bodySize;
+	CryptCtx->AesTailStart   = Head->FileNameTableStartAddress;
+	CryptCtx->AesTailEnd     = (u64)ArchiveSize;
+	CryptCtx->AesTailCounter = (bodySize + wolf::crypt::aes::BLOCKLEN - 1) / wolf::crypt::aes::BLOCKLEN * wolf::crypt::aes::BLOCKLEN;
+}
+
+// 鍵文字列を使用して Xor 演算( Key は必ず DXA_KEY_BYTES の長さがなければならない )
+void DXArchive::KeyConv(void *Data, s64 Size, s64 Position, unsigned char *Key, const DARC_CRYPTCONTEXT *CryptCtx)
+{
+	if (CryptCtx != NULL && CryptCtx->NewCrypt)
 	{
-		s64 i, j;
+		wolf::crypt::wolfCrypt(CryptCtx->SpecialKey, reinterpret_cast<uint8_t *>(Data), Position, Position + Size, false, CryptCtx->CryptVersion);
+		return;
+	}
 
-		j = Position;
-		for (i = 0; i < Size; i++)
-		{
-			((u8 *)Data)[i] ^= Key[j];
+	if (CryptCtx != NULL && CryptCtx->ChaCha20)
+	{
+		wolf::crypt::chacha20::xorKeyStream(CryptCtx->CC20Key, CryptCtx->CC20Nonce, static_cast<uint32_t>(Position), reinterpret_cast<uint8_t *>(Data), Size);
+		return;
+	}
 
-			j++;
-			if (j == DXA_KEY_BYTES) j = 0;
-		}
+	if (Key == NULL || Size <= 0)
+	{
+		return;
 	}
+
+	// The key repeats every DXA_KEY_BYTES bytes, so the data is XORed with a repeated key in wide blocks
+	wolf::crypt::detail::xorRepeatingKey(reinterpret_cast<uint8_t *>(Data), Key, DXA_KEY_BYTES, (u32)(Position % DXA_KEY_BYTES), (size_t)Size);
 }
 
 // データを鍵文字列を使用して Xor 演算した後ファイルに書き出す関数( Key は必ず DXA_KEY_BYTES の長さがなければならない )
-void DXArchive::KeyConvFileWrite(void *Data, s64 Size, FILE *fp, unsigned char *Key, s64 Position)
+void DXArchive::KeyConvFileWrite(void *Data, s64 Size, FILE *fp, unsigned char *Key, s64 Position, const DARC_CRYPTCONTEXT *CryptCtx)
 {
 	s64 pos = 0;
 
@@ -635,7 +691,7 @@ void DXArchive::KeyConvFileWrite(void *Data, s64 Size, FILE *fp, unsigned char *
 		pos = Position == -1 ? _ftelli64(fp) : Position;
 
 		// データを鍵文字列を使って Xor 演算する
-		KeyConv(Data, Size, pos, Key);
+		KeyConv(Data, Size, pos, Key, CryptCtx);
 	}
 
 	// 書き出す
@@ -644,12 +700,12 @@ void DXArchive::KeyConvFileWrite(void *Data, s64 Size, FILE *fp, unsigned char *
 	if (Key != NULL)
 	{
 		// 再び Xor 演算
-		KeyConv(Data, Size, pos, Key);
+		KeyConv(Data, Size, pos, Key, CryptCtx);
 	}
 }
 
 // ファイルから読み込んだデータを鍵文字列を使用して Xor 演算する関数( Key は必ず DXA_KEY_BYTES の長さがなければならない )
-void DXArchive::KeyConvFileRead(void *Data, s64 Size, FILE *fp, unsigned char *Key, s64 Position)
+void DXArchive::KeyConvFileRead(void *Data, s64 Size, FILE *fp, unsigned char *Key, s64 Position, const DARC_CRYPTCONTEXT *CryptCtx)
 {
 	s64 pos = 0;
 
@@ -665,12 +721,365 @@ void DXArchive::KeyConvFileRead(void *Data, s64 Size, FILE *fp, unsigned char *K
 	if (Key != NULL)
 	{
 		// データを鍵文字列を使って Xor 演算
-		KeyConv(Data, Size, pos, Key);
+		KeyConv(Data, Size, pos, Key, CryptCtx);
+	}
+}
+
+// Get the current read position of the archive source
+s64 DXArchive::SourceTell(DARC_SOURCE *Src)
+{
+	if (Src->Image != NULL)
+		return (s64)Src->Position;
+
+	return _ftelli64(Src->fp);
+}
+
+// Set the read position of the archive source
+void DXArchive::SourceSeek(DARC_SOURCE *Src, s64 Position)
+{
+	if (Src->Image != NULL)
+		Src->Position = (u64)Position;
+	else
+		_fseeki64(Src->fp, Position, SEEK_SET);
+}
+
+// Get the total size of the archive source
+s64 DXArchive::SourceSize(DARC_SOURCE *Src)
+{
+	if (Src->Image != NULL)
+		return (s64)Src->ImageSize;
+
+	const s64 Pos = _ftelli64(Src->fp);
+	_fseeki64(Src->fp, 0, SEEK_END);
+	const s64 Size = _ftelli64(Src->fp);
+	_fseeki64(Src->fp, Pos, SEEK_SET);
+
+	return Size;
+}
+
+// Read data from the archive source
+void DXArchive::SourceRead(void *Buffer, s64 Size, DARC_SOURCE *Src)
+{
+	if (Src->Image == NULL)
+	{
+		const s64 Position = Src->CryptCtx != NULL ? _ftelli64(Src->fp) : 0;
+
+		fread64(Buffer, Size, Src->fp);
+		SourceDecrypt(Src, Buffer, Size, Position);
+		return;
 	}
+
+	// Behave like fread at the end of the file and only copy what is left in the image
+	u64 CopySize = (u64)Size;
+	if (Src->Position >= Src->ImageSize)
+		CopySize = 0;
+	else if (CopySize > Src->ImageSize - Src->Position)
+		CopySize = Src->ImageSize - Src->Position;
+
+	memcpy(Buffer, Src->Image + Src->Position, (size_t)CopySize);
+	SourceDecrypt(Src, Buffer, (s64)CopySize, (s64)Src->Position);
+	Src->Position += CopySize;
+}
+
+// Same as KeyConvFileRead but reads from the archive source
+void DXArchive::KeyConvSourceRead(void *Data, s64 Size, DARC_SOURCE *Src, unsigned char *Key, s64 Position, const DARC_CRYPTCONTEXT *CryptCtx)
+{
+	s64 pos = 0;
+
+	if (Key != NULL)
+		pos = Position == -1 ? SourceTell(Src) : Position;
+
+	SourceRead(Data, Size, Src);
+
+	if (Key != NULL)
+		KeyConv(Data, Size, pos, Key, CryptCtx);
+}
+
+// Read data from the given position of the archive source without moving the read position, can be called from multiple threads
+// Returns the number of bytes read, less than Size when the archive ends early or the read fails
+s64 DXArchive::SourceReadAt(void *Buffer, s64 Size, s64 Position, DARC_SOURCE *Src)
+{
+	if (Src->Image != NULL)
+	{
+		// The image can be a window of the archive starting at ImageBase
+		Position -= Src->ImageBase;
+
+		// Behave like SourceRead at the end of the image
+		u64 CopySize = (u64)Size;
+		if ((u64)Position >= Src->ImageSize)
+			CopySize = 0;
+		else if (CopySize > Src->ImageSize - (u64)Position)
+			CopySize = Src->ImageSize - (u64)Position;
+
+		memcpy(Buffer, Src->Image + Position, (size_t)CopySize);
+		SourceDecrypt(Src, Buffer, (s64)CopySize, Position + (s64)Src->ImageBase);
+		return (s64)CopySize;
+	}
+
+	// Positioned reads, the FILE cursor is shared and can not be used by the workers.
+	// The kernel serializes the reads on a synchronous handle, so the workers use the overlapped handle when there is one
+	HANDLE Event         = Src->ReadHandle != NULL ? CreateEvent(NULL, TRUE, FALSE, NULL) : NULL;
+	HANDLE HFile         = Event != NULL ? (HANDLE)Src->ReadHandle : (HANDLE)_get_osfhandle(_fileno(Src->fp));
+	u8 *Dest             = (u8 *)Buffer;
+	const s64 ReadBegin  = Position;
+	const s64 ReadLength = Size;
+
+	while (Size > 0)
+	{
+		OVERLAPPED Overlapped;
+		DWORD ReadSize  = Size > 0x40000000 ? 0x40000000 : (DWORD)Size;
+		DWORD ReadBytes = 0;
+
+		memset(&Overlapped, 0, sizeof(OVERLAPPED));
+		Overlapped.Offset     = (DWORD)(Position & 0xffffffff);
+		Overlapped.OffsetHigh = (DWORD)(Position >> 32);
+		Overlapped.hEvent     = Event;
+
+		BOOL Read = ReadFile(HFile, Dest, ReadSize, &ReadBytes, &Overlapped);
+		if (Read == FALSE && GetLastError() == ERROR_IO_PENDING)
+			Read = GetOverlappedResult(HFile, &Overlapped, &ReadBytes, TRUE);
+
+		if (Read == FALSE || ReadBytes == 0) break;
+
+		Dest += ReadBytes;
+		Position += ReadBytes;
+		Size -= ReadBytes;
+	}
+
+	if (Event != NULL) CloseHandle(Event);
+
+	SourceDecrypt(Src, Buffer, ReadLength - Size, ReadBegin);
+
+	return ReadLength - Size;
+}
+
+// Remove the archive wide crypt layers of the v3.31+ crypt from Size bytes read from Position of the archive file,
+// all layers are position keyed XOR streams so any window of the archive can be decrypted on its own
+void DXArchive::SourceDecrypt(const DARC_SOURCE *Src, void *Data, s64 Size, s64 Position)
+{
+	const DARC_CRYPTCONTEXT *CryptCtx = Src->CryptCtx;
+	u8 *Dest                          = (u8 *)Data;
+	const u64 Begin                   = (u64)Position;
+	const u64 End                     = (u64)(Position + Size);
+
+	if (CryptCtx == NULL || CryptCtx->ArchiveCrypt == false || Size <= 0) return;
+
+	// Clip the read window to the range of a layer, returns false when they do not overlap
+	auto Clip = [&](u64 LayerStart, u64 LayerEnd, u64 &ClipBegin, u64 &ClipEnd) {
+		ClipBegin = Begin > LayerStart ? Begin : LayerStart;
+		ClipEnd   = End < LayerEnd ? End : LayerEnd;
+		return ClipBegin < ClipEnd;
+	};
+
+	u64 ClipBegin, ClipEnd;
+
+	if (Clip(CryptCtx->ArchiveKeyStart, CryptCtx->ArchiveKeyEnd, ClipBegin, ClipEnd))
+		wolf::crypt::wolfCrypt(CryptCtx->ArchiveKey, Dest + (ClipBegin - Begin), (int64_t)ClipBegin, (int64_t)ClipEnd, false, CryptCtx->CryptVersion);
+
+	if (CryptCtx->ArchiveAes == false) return;
+
+	if (Clip(CryptCtx->AesBodyStart, CryptCtx->AesBodyEnd, ClipBegin, ClipEnd))
+		wolf::crypt::aes::aesCtrXCryptAt(Dest + (ClipBegin - Begin), CryptCtx->AesRoundKey, (size_t)(ClipEnd - ClipBegin), ClipBegin - CryptCtx->AesBodyStart);
+
+	if (Clip(CryptCtx->AesTailStart, CryptCtx->AesTailEnd, ClipBegin, ClipEnd))
+		wolf::crypt::aes::aesCtrXCryptAt(Dest + (ClipBegin - Begin), CryptCtx->AesRoundKey, (size_t)(ClipEnd - ClipBegin), CryptCtx->AesTailCounter + (ClipBegin - CryptCtx->AesTailStart));
+}
+
+// Same as KeyConvSourceRead but reads from ReadPosition of the archive source, Position is the key position
+// Fails when less than Size bytes could be read, the buffer must not be used then
+int DXArchive::KeyConvSourceReadAt(void *Data, s64 Size, s64 ReadPosition, DARC_SOURCE *Src, unsigned char *Key, s64 Position, const DARC_CRYPTCONTEXT *CryptCtx)
+{
+	// Copy memory sources in small pieces and decrypt each piece right away while it is still in the cache,
+	// instead of copying everything first and running over the whole buffer a second time
+	if (Src->Image != NULL && (Key != NULL || Src->CryptCtx != NULL))
+	{
+		const s64 KeyPosition = Position == -1 ? ReadPosition : Position;
+
+		for (s64 Offset = 0; Offset < Size; Offset += SOURCE_CONVSIZE)
+		{
+			const s64 ConvSize = Size - Offset > SOURCE_CONVSIZE ? SOURCE_CONVSIZE : Size - Offset;
+
+			if (SourceReadAt((u8 *)Data + Offset, ConvSize, ReadPosition + Offset, Src) != ConvSize) return -1;
+
+			if (Key != NULL)
+				KeyConv((u8 *)Data + Offset, ConvSize, KeyPosition + Offset, Key, CryptCtx);
+		}
+		return 0;
+	}
+
+	if (SourceReadAt(Data, Size, ReadPosition, Src) != Size) return -1;
+
+	if (Key != NULL)
+		KeyConv(Data, Size, Position == -1 ? ReadPosition : Position, Key, CryptCtx);
+
+	return 0;
+}
+
+// Same as KeyConvSourceReadAt but returns the data inside the mapping instead of copying it when it needs no decryption
+const u8 *DXArchive::KeyConvSourceFetch(void *Buffer, s64 Size, s64 ReadPosition, DARC_SOURCE *Src, unsigned char *Key, s64 Position, const DARC_CRYPTCONTEXT *CryptCtx)
+{
+	if (Key == NULL)
+	{
+		const u8 *View = SourceView(Src, ReadPosition, Size);
+		if (View != NULL) return View;
+	}
+
+	if (KeyConvSourceReadAt(Buffer, Size, ReadPosition, Src, Key, Position, CryptCtx) < 0) return NULL;
+
+	return (const u8 *)Buffer;
+}
+
+// Map the archive file into memory, reads are served from the mapped pages from now on
+// Fails e.g., for empty files or when the address space is too small, the file is read with fp then
+bool DXArchive::SourceMap(DARC_SOURCE *Src)
+{
+	HANDLE HFile = (HANDLE)_get_osfhandle(_fileno(Src->fp));
+	LARGE_INTEGER FileSize;
+
+	if (GetFileSizeEx(HFile, &FileSize) == FALSE || FileSize.QuadPart == 0 || (u64)FileSize.QuadPart > (u64)SIZE_MAX) return false;
+
+	HANDLE Mapping = CreateFileMapping(HFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (Mapping == NULL) return false;
+
+	u8 *View = (u8 *)MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0);
+	if (View == NULL)
+	{
+		CloseHandle(Mapping);
+		return false;
+	}
+
+	Src->Mapping   = Mapping;
+	Src->Image     = View;
+	Src->ImageSize = (u64)FileSize.QuadPart;
+	Src->ImageBase = 0;
+	Src->Position  = (u64)_ftelli64(Src->fp);
+
+	return true;
+}
+
+// Check if the archive is on a local fixed drive, only those are mapped
+// A page-in from a network or removable volume can fail, which raises an access fault instead of returning a read error
+bool DXArchive::SourceIsLocal(const TCHAR *ArchiveName)
+{
+	TCHAR VolumePath[MAX_PATH];
+
+	if (GetVolumePathName(ArchiveName, VolumePath, MAX_PATH) == FALSE) return false;
+
+	const UINT DriveType = GetDriveType(VolumePath);
+
+	return DriveType == DRIVE_FIXED || DriveType == DRIVE_RAMDISK;
+}
+
+// Release the mapping of the archive file
+void DXArchive::SourceUnmap(DARC_SOURCE *Src)
+{
+	if (Src->Mapping == NULL) return;
+
+	UnmapViewOfFile(Src->Image);
+	CloseHandle((HANDLE)Src->Mapping);
+
+	Src->Mapping   = NULL;
+	Src->Image     = NULL;
+	Src->ImageSize = 0;
+}
+
+// Get data of a mapped archive that can be used as is, the archive wide crypt layers still have to be removed by reading it
+const u8 *DXArchive::SourceView(const DARC_SOURCE *Src, s64 Position, s64 Size)
+{
+	if (Src->Mapping == NULL || Src->CryptCtx != NULL) return NULL;
+
+	if (Position < 0 || Size < 0 || (u64)Position > Src->ImageSize || (u64)Size > Src->ImageSize - (u64)Position) return NULL;
+
+	return Src->Image + Position;
+}
+
+// Check if an entry passes the include and exclude filters, empty lists extract everything
+bool DXArchive::IsEntrySelected(const DARC_DECODEOPTIONS *Options, const TCHAR *Path)
+{
+	bool Selected = Options->Include.empty();
+
+	for (const std::wstring &Pattern : Options->Include)
+	{
+		if (MatchEntryPattern(Pattern, Path))
+		{
+			Selected = true;
+			break;
+		}
+	}
+
+	if (Selected == false) return false;
+
+	for (const std::wstring &Pattern : Options->Exclude)
+	{
+		if (MatchEntryPattern(Pattern, Path)) return false;
+	}
+
+	return true;
+}
+
+// Check if an entry matches a pattern, patterns without a separator are matched against every path component,
+// patterns with a separator against the path and all of its parent directories
+bool DXArchive::MatchEntryPattern(const std::wstring &Pattern, const TCHAR *Path)
+{
+	const bool HasSeparator = Pattern.find_first_of(TEXT("\\/")) != std::wstring::npos;
+	const TCHAR *Begin      = Path;
+
+	for (const TCHAR *p = Path;; p++)
+	{
+		if (*p == TEXT('\0') || *p == TEXT('\\') || *p == TEXT('/'))
+		{
+			if (MatchPattern(Pattern.c_str(), HasSeparator ? Path : Begin, p)) return true;
+			if (*p == TEXT('\0')) return false;
+
+			Begin = p + 1;
+		}
+	}
+}
+
+// Match [Path, PathEnd) against a glob pattern, case insensitive
+// '*' matches anything but a directory separator, '**' also matches separators and '?' matches a single character
+bool DXArchive::MatchPattern(const TCHAR *Pattern, const TCHAR *Path, const TCHAR *PathEnd)
+{
+	auto IsSeparator = [](TCHAR c) { return c == TEXT('\\') || c == TEXT('/'); };
+
+	while (*Pattern != TEXT('\0'))
+	{
+		if (*Pattern == TEXT('*'))
+		{
+			const bool AnyDepth = Pattern[1] == TEXT('*');
+
+			Pattern += AnyDepth ? 2 : 1;
+
+			// Try every possible length for the wildcard
+			for (const TCHAR *p = Path;; p++)
+			{
+				if (MatchPattern(Pattern, p, PathEnd)) return true;
+				if (p == PathEnd || (AnyDepth == false && IsSeparator(*p))) return false;
+			}
+		}
+
+		if (Path == PathEnd) return false;
+
+		if (*Pattern == TEXT('?'))
+		{
+			if (IsSeparator(*Path)) return false;
+		}
+		else if (IsSeparator(*Pattern))
+		{
+			if (IsSeparator(*Path) == false) return false;
+		}
+		else if (_totlower(*Pattern) != _totlower(*Path))
+			return false;
+
+		Pattern++;
+		Path++;
+	}
+
+	return Path == PathEnd;
 }
 
 // 指定のディレクトリにあるファイルをアーカイブデータに吐き出す
-int DXArchive::DirectoryEncode(int CharCodeFormat, TCHAR *DirectoryName, u8 *NameP, u8 *DirP, u8 *FileP, DARC_DIRECTORY *ParentDir, SIZESAVE *Size, int DataNumber, FILE *DestFp, void *TempBuffer, bool Press, bool MaxPress, bool AlwaysHuffman, u8 HuffmanEncodeKB, const char *KeyString, size_t KeyStringBytes, bool NoKey, char *KeyStringBuffer, DARC_ENCODEINFO *EncodeInfo)
+int DXArchive::DirectoryEncode(int CharCodeFormat, TCHAR *DirectoryName, u8 *NameP, u8 *DirP, u8 *FileP, DARC_DIRECTORY *ParentDir, SIZESAVE *Size, int DataNumber, FILE *DestFp, void *TempBuffer, bool Press, bool MaxPress, bool AlwaysHuffman, u8 HuffmanEncodeKB, const char *KeyString, size_t KeyStringBytes, bool NoKey, char *KeyStringBuffer, DARC_ENCODEINFO *EncodeInfo, const DARC_CRYPTCONTEXT *CryptCtx)
 {
 	TCHAR DirPath[MAX_PATH];
 	WIN32_FIND_DATA FindData;
@@ -764,7 +1173,7 @@ int DXArchive::DirectoryEncode(int CharCodeFormat, TCHAR *DirectoryName, u8 *Nam
 			if (FindData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
 			{
 				// ディレクトリだった場合の処理
-				if (DirectoryEncode(CharCodeFormat, FindData.cFileName, NameP, DirP, FileP, &Dir, Size, i, DestFp, TempBuffer, Press, MaxPress, AlwaysHuffman, HuffmanEncodeKB, KeyString, KeyStringBytes, NoKey, KeyStringBuffer, EncodeInfo) < 0) return -1;
+				if (DirectoryEncode(CharCodeFormat, FindData.cFileName, NameP, DirP, FileP, &Dir, Size, i, DestFp, TempBuffer, Press, MaxPress, AlwaysHuffman, HuffmanEncodeKB, KeyString, KeyStringBytes, NoKey, KeyStringBuffer, EncodeInfo, CryptCtx) < 0) return -1;
 			}
 			else
 			{
@@ -939,7 +1348,7 @@ int DXArchive::DirectoryEncode(int CharCodeFormat, TCHAR *DirectoryName, u8 *Nam
 
 								// 圧縮データに鍵を適用して書き出す
 								WriteSize = (File.HuffPressDataSize + 3) / 4 * 4; // サイズは４の倍数に合わせる
-								KeyConvFileWrite(HuffData, WriteSize, DestFp, NoKey ? NULL : lKey, File.DataSize);
+								KeyConvFileWrite(HuffData, WriteSize, DestFp, NoKey ? NULL : lKey, File.DataSize, CryptCtx);
 							}
 							else
 							{
@@ -952,12 +1361,12 @@ int DXArchive::DirectoryEncode(int CharCodeFormat, TCHAR *DirectoryName, u8 *Nam
 								File.HuffPressDataSize = Huffman_Encode(HuffData, HuffmanEncodeKB * 1024 * 2, HuffData + HuffmanEncodeKB * 1024 * 2);
 
 								// ハフマン圧縮した部分を書き出す
-								KeyConvFileWrite(HuffData + HuffmanEncodeKB * 1024 * 2, File.HuffPressDataSize, DestFp, NoKey ? NULL : lKey, File.DataSize);
+								KeyConvFileWrite(HuffData + HuffmanEncodeKB * 1024 * 2, File.HuffPressDataSize, DestFp, NoKey ? NULL : lKey, File.DataSize, CryptCtx);
 
 								// ハフマン圧縮していない箇所を書き出す
 								WriteSize = File.HuffPressDataSize + DestSize - HuffmanEncodeKB * 1024 * 2;
 								WriteSize = (WriteSize + 3) / 4 * 4; // サイズは４の倍数に合わせる
-								KeyConvFileWrite((u8 *)DestBuf + HuffmanEncodeKB * 1024, WriteSize - File.HuffPressDataSize, DestFp, NoKey ? NULL : lKey, File.DataSize + File.HuffPressDataSize);
+								KeyConvFileWrite((u8 *)DestBuf + HuffmanEncodeKB * 1024, WriteSize - File.HuffPressDataSize, DestFp, NoKey ? NULL : lKey, File.DataSize + File.HuffPressDataSize, CryptCtx);
 							}
 
 							// メモリの解放
@@ -967,7 +1376,7 @@ int DXArchive::DirectoryEncode(int CharCodeFormat, TCHAR *DirectoryName, u8 *Nam
 						{
 							// 圧縮データを反転して書き出す
 							WriteSize = (DestSize + 3) / 4 * 4;
-							KeyConvFileWrite(DestBuf, WriteSize, DestFp, NoKey ? NULL : lKey, File.DataSize);
+							KeyConvFileWrite(DestBuf, WriteSize, DestFp, NoKey ? NULL : lKey, File.DataSize, CryptCtx);
 						}
 
 						// メモリの解放
@@ -998,7 +1407,7 @@ int DXArchive::DirectoryEncode(int CharCodeFormat, TCHAR *DirectoryName, u8 *Nam
 
 								// 圧縮データに鍵を適用して書き出す
 								WriteSize = (File.HuffPressDataSize + 3) / 4 * 4; // サイズは４の倍数に合わせる
-								KeyConvFileWrite(HuffData, WriteSize, DestFp, NoKey ? NULL : lKey, File.DataSize);
+								KeyConvFileWrite(HuffData, WriteSize, DestFp, NoKey ? NULL : lKey, File.DataSize, CryptCtx);
 							}
 							else
 							{
@@ -1011,12 +1420,12 @@ int DXArchive::DirectoryEncode(int CharCodeFormat, TCHAR *DirectoryName, u8 *Nam
 								File.HuffPressDataSize = Huffman_Encode(HuffData, HuffmanEncodeKB * 1024 * 2, HuffData + HuffmanEncodeKB * 1024 * 2);
 
 								// ハフマン圧縮した部分を書き出す
-								KeyConvFileWrite(HuffData + HuffmanEncodeKB * 1024 * 2, File.HuffPressDataSize, DestFp, NoKey ? NULL : lKey, File.DataSize);
+								KeyConvFileWrite(HuffData + HuffmanEncodeKB * 1024 * 2, File.HuffPressDataSize, DestFp, NoKey ? NULL : lKey, File.DataSize, CryptCtx);
 
 								// ハフマン圧縮していない箇所を書き出す
 								WriteSize = File.HuffPressDataSize + FileSize - HuffmanEncodeKB * 1024 * 2;
 								WriteSize = (WriteSize + 3) / 4 * 4; // サイズは４の倍数に合わせる
-								KeyConvFileWrite(SrcBuf + HuffmanEncodeKB * 1024, WriteSize - File.HuffPressDataSize, DestFp, NoKey ? NULL : lKey, File.DataSize + File.HuffPressDataSize);
+								KeyConvFileWrite(SrcBuf + HuffmanEncodeKB * 1024, WriteSize - File.HuffPressDataSize, DestFp, NoKey ? NULL : lKey, File.DataSize + File.HuffPressDataSize, CryptCtx);
 							}
 
 							// メモリの解放
@@ -1035,7 +1444,7 @@ int DXArchive::DirectoryEncode(int CharCodeFormat, TCHAR *DirectoryName, u8 *Nam
 
 								// ファイルの鍵適用読み込み
 								memset(TempBuffer, 0, (size_t)MoveSize);
-								KeyConvFileRead(TempBuffer, MoveSize, SrcP, NoKey ? NULL : lKey, File.DataSize + WriteSize);
+								KeyConvFileRead(TempBuffer, MoveSize, SrcP, NoKey ? NULL : lKey, File.DataSize + WriteSize, CryptCtx);
 
 								// 書き出し
 								fwrite64(TempBuffer, MoveSize, DestFp);
@@ -1071,315 +1480,773 @@ int DXArchive::DirectoryEncode(int CharCodeFormat, TCHAR *DirectoryName, u8 *Nam
 	return 0;
 }
 
-// 指定のディレクトリデータにあるファイルを展開する
-int DXArchive::DirectoryDecode(u8 *NameP, u8 *DirP, u8 *FileP, DARC_HEAD *Head, DARC_DIRECTORY *Dir, FILE *ArcP, unsigned char *Key, const char *KeyString, size_t KeyStringBytes, bool NoKey, char *KeyStringBuffer)
+// Build the decoded entry list of an archive from the raw header tables
+int DXArchive::BuildArchiveModel(u8 *NameP, u8 *DirP, u8 *FileP, DARC_HEAD *Head, const char *KeyString, size_t KeyStringBytes, bool NoKey, char *KeyStringBuffer, DARC_ARCHIVEMODEL *Model)
 {
-	TCHAR DirPath[MAX_PATH];
+	Model->Entries.clear();
+	Model->NameArena.clear();
 
-	// 現在のカレントディレクトリを保存
-	GetCurrentDirectory(MAX_PATH, DirPath);
+	// The tables have to be laid out in order inside the header, checked without additions so huge addresses can not wrap around
+	if (Head->FileTableStartAddress > Head->DirectoryTableStartAddress || Head->DirectoryTableStartAddress > Head->HeadSize || Head->HeadSize - Head->DirectoryTableStartAddress < sizeof(DARC_DIRECTORY)) return -1;
+
+	// The parent chain of every directory ends at the root
+	if (((DARC_DIRECTORY *)DirP)->ParentDirectoryAddress != 0xffffffffffffffff) return -1;
 
-	// ディレクトリ情報がある場合は、まず展開用のディレクトリを作成する
-	if (Dir->DirectoryAddress != 0xffffffffffffffff && Dir->ParentDirectoryAddress != 0xffffffffffffffff)
+	// The file table size is an upper bound for the number of entries
+	Model->Entries.reserve((size_t)((Head->DirectoryTableStartAddress - Head->FileTableStartAddress) / sizeof(DARC_FILEHEAD)));
+
+	return DirectoryBuildModel(NameP, DirP, FileP, Head, (DARC_DIRECTORY *)DirP, TEXT(""), DARC_ENTRY_ROOT, KeyString, KeyStringBytes, NoKey, KeyStringBuffer, Model);
+}
+
+// Add the entries of the given directory data to the model, DirPath is the path of the directory inside the archive
+int DXArchive::DirectoryBuildModel(u8 *NameP, u8 *DirP, u8 *FileP, DARC_HEAD *Head, DARC_DIRECTORY *Dir, const std::wstring &DirPath, size_t DirIndex, const char *KeyString, size_t KeyStringBytes, bool NoKey, char *KeyStringBuffer, DARC_ARCHIVEMODEL *Model)
+{
+	u32 i, FileHeadSize;
+	DARC_FILEHEAD *File;
+	size_t KeyStringBufferBytes;
+	const u64 FileTableSize = Head->DirectoryTableStartAddress - Head->FileTableStartAddress;
+
+	// Reject directories pointing outside of the file table, a wrong key or a damaged archive would otherwise read out of bounds
+	if (Dir->FileHeadAddress > FileTableSize || Dir->FileHeadNum > (FileTableSize - Dir->FileHeadAddress) / sizeof(DARC_FILEHEAD)) return -1;
+
+	// 格納されているファイルの数だけ繰り返す
+	FileHeadSize = sizeof(DARC_FILEHEAD);
+	File         = (DARC_FILEHEAD *)(FileP + Dir->FileHeadAddress);
+	for (i = 0; i < Dir->FileHeadNum; i++, File = (DARC_FILEHEAD *)((u8 *)File + FileHeadSize))
 	{
-		DARC_FILEHEAD *DirFile;
+		DARC_ENTRY Entry;
 
-		// DARC_FILEHEAD のアドレスを取得
-		DirFile = (DARC_FILEHEAD *)(FileP + Dir->DirectoryAddress);
+		memset(&Entry, 0, sizeof(DARC_ENTRY));
 
-		// ディレクトリの作成
-		TCHAR *pName = GetOriginalFileName(NameP + DirFile->NameAddress);
-		CreateDirectory(pName, NULL);
-		delete[] pName;
+		// The name is stored twice, upper case and as is, each zero terminated inside PackNum * 4 bytes
+		if (Head->FileTableStartAddress < 4 || File->NameAddress > Head->FileTableStartAddress - 4) return -1;
+		const u64 PackBytes = (u64)*((u16 *)(NameP + File->NameAddress)) * 4;
+		if (PackBytes == 0 || PackBytes * 2 > Head->FileTableStartAddress - File->NameAddress - 4) return -1;
+		if (NameP[File->NameAddress + 4 + PackBytes - 1] != 0 || NameP[File->NameAddress + 4 + PackBytes * 2 - 1] != 0) return -1;
+
+		if (File->Attributes & FILE_ATTRIBUTE_DIRECTORY)
+		{
+			const u64 DirTableSize = Head->HeadSize - Head->DirectoryTableStartAddress;
+
+			if (File->DataAddress > DirTableSize - sizeof(DARC_DIRECTORY)) return -1;
 
-		// そのディレクトリにカレントディレクトリを移す
-		pName = GetOriginalFileName(NameP + DirFile->NameAddress);
-		SetCurrentDirectory(pName);
+			// A directory has to link back to its file head and to this directory, so every directory is entered once and the parent chain the file keys are made from stays inside the tables
+			const DARC_DIRECTORY *SubDir = (DARC_DIRECTORY *)(DirP + File->DataAddress);
+			if (SubDir->DirectoryAddress != (u64)((u8 *)File - FileP) || SubDir->ParentDirectoryAddress != (u64)((u8 *)Dir - DirP)) return -1;
+		}
+
+		// Each file head ends up in the model at most once
+		if (Model->Entries.size() >= FileTableSize / sizeof(DARC_FILEHEAD)) return -1;
+
+		TCHAR *pName            = GetOriginalFileName(NameP + File->NameAddress);
+		const std::wstring Path = DXArchiveSink::JoinPath(DirPath, pName);
+
+		Entry.PathOffset        = Model->NameArena.size();
+		Entry.ParentIndex       = DirIndex;
+		Entry.Attributes        = File->Attributes;
+		Entry.Time              = File->Time;
+		Entry.DataPosition      = Head->DataStartAddress + File->DataAddress;
+		Entry.DataSize          = File->DataSize;
+		Entry.PressDataSize     = File->PressDataSize;
+		Entry.HuffPressDataSize = File->HuffPressDataSize;
+		Entry.Directory         = (File->Attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+		Entry.AntiUnpack        = Entry.Directory == false && IsAntiUnpackFile(pName);
 		delete[] pName;
+
+		Model->NameArena.insert(Model->NameArena.end(), Path.c_str(), Path.c_str() + Path.size() + 1);
+
+		// ディレクトリかどうかで処理を分岐
+		if (Entry.Directory)
+		{
+			size_t Depth = 0;
+
+			// Limit the nesting so a crafted archive can not exhaust the stack
+			for (size_t j = DirIndex; j != DARC_ENTRY_ROOT; j = Model->Entries[j].ParentIndex) Depth++;
+			if (Depth >= DXA_MAXDIRECTORYDEPTH) return -1;
+
+			// Directories are stored in front of their content so they can be created in order
+			Model->Entries.push_back(Entry);
+
+			// ディレクトリの場合は再帰をかける
+			if (DirectoryBuildModel(NameP, DirP, FileP, Head, (DARC_DIRECTORY *)(DirP + File->DataAddress), Path, Model->Entries.size() - 1, KeyString, KeyStringBytes, NoKey, KeyStringBuffer, Model) < 0) return -1;
+		}
+		else
+		{
+			// ファイル個別の鍵を作成
+			if (NoKey == false)
+			{
+				KeyStringBufferBytes = CreateKeyFileString((int)Head->CharCodeFormat, KeyString, KeyStringBytes, Dir, File, FileP, DirP, NameP, (BYTE *)KeyStringBuffer);
+				KeyCreate(KeyStringBuffer, KeyStringBufferBytes, Entry.Key);
+			}
+
+			Model->Entries.push_back(Entry);
+		}
 	}
 
-	// 展開処理開始
+	// 終了
+	return 0;
+}
+
+// 指定のディレクトリデータにあるファイルを展開する
+int DXArchive::DirectoryDecode(DARC_HEAD *Head, const DARC_ARCHIVEMODEL *Model, DXArchiveSink *Sink, DARC_SOURCE *ArcP, bool NoKey, const DARC_CRYPTCONTEXT *CryptCtx, const DARC_DECODEOPTIONS *Options)
+{
+	std::vector<const DARC_ENTRY *> Files;
+	std::vector<DARC_DECODEBATCH> Batches;
+	std::atomic<size_t> NextBatch = 0;
+	std::atomic<bool> Failed      = false;
+	size_t ThreadNum;
+	u64 MaxWorkSize = 0;
+	std::vector<u8> Selected;
+
+	Files.reserve(Model->Entries.size());
+
+	// Apply the filters to the entry list before any data is read, the parents of selected entries are always created
+	Selected.resize(Model->Entries.size(), Options->Include.empty() && Options->Exclude.empty() ? 1 : 0);
+	if (Selected.empty() == false && Selected[0] == 0)
 	{
-		u32 i, FileHeadSize;
-		DARC_FILEHEAD *File;
-		size_t KeyStringBufferBytes;
-		unsigned char lKey[DXA_KEY_BYTES];
+		for (size_t i = 0; i < Model->Entries.size(); i++)
+		{
+			if (IsEntrySelected(Options, GetEntryPath(Model, &Model->Entries[i])) == false) continue;
 
-		// 格納されているファイルの数だけ繰り返す
-		FileHeadSize = sizeof(DARC_FILEHEAD);
-		File         = (DARC_FILEHEAD *)(FileP + Dir->FileHeadAddress);
-		for (i = 0; i < Dir->FileHeadNum; i++, File = (DARC_FILEHEAD *)((u8 *)File + FileHeadSize))
+			for (size_t j = i; j != DARC_ENTRY_ROOT && Selected[j] == 0; j = Model->Entries[j].ParentIndex)
+				Selected[j] = 1;
+		}
+	}
+
+	// Create the directories up front, parents come before their children in the model
+	for (size_t i = 0; i < Model->Entries.size(); i++)
+	{
+		const DARC_ENTRY &Entry = Model->Entries[i];
+
+		if (Selected[i] == 0) continue;
+
+		if (Entry.Directory)
 		{
-			// ディレクトリかどうかで処理を分岐
-			if (File->Attributes & FILE_ATTRIBUTE_DIRECTORY)
+			if (Sink->MakeDirectory(GetEntryPath(Model, &Entry)) < 0) return -1;
+		}
+		else
+		{
+			const u64 WorkSize = GetDecodeWorkSize(Head, &Entry);
+			if (WorkSize > MaxWorkSize) MaxWorkSize = WorkSize;
+
+			Files.push_back(&Entry);
+		}
+	}
+
+	// Extract in the order the data is stored in the archive instead of the directory order,
+	// this turns the reads into a mostly sequential scan of the archive
+	std::stable_sort(Files.begin(), Files.end(), [](const DARC_ENTRY *a, const DARC_ENTRY *b) { return a->DataPosition < b->DataPosition; });
+
+	CreateDecodeBatches(Head, Files, ArcP->Image == NULL, &Batches);
+
+	ThreadNum = Options->ThreadNum > 0 ? (size_t)Options->ThreadNum : std::thread::hardware_concurrency();
+	if (ThreadNum > Batches.size()) ThreadNum = Batches.size();
+	if (ThreadNum == 0) ThreadNum = 1;
+
+	// Every file has its own data address and key, so the workers only have to share the batch index
+	auto Worker = [&]() {
+		DARC_DECODEBUFFER Buffer    = { NULL, 0 };
+		DARC_DECODEBUFFER ReadAhead = { NULL, 0 };
+
+		// Size the work buffer for the largest entry up front so the common case never has to grow it,
+		// only archives with entries above DXA_BUFFERSIZE grow it on demand
+		if (ReserveDecodeBuffer(&Buffer, MaxWorkSize < DXA_BUFFERSIZE ? MaxWorkSize : DXA_BUFFERSIZE) == NULL)
+		{
+			Failed = true;
+			return;
+		}
+
+		for (size_t i = NextBatch++; i < Batches.size(); i = NextBatch++)
+		{
+			const DARC_DECODEBATCH &Batch = Batches[i];
+			DARC_SOURCE View;
+			DARC_SOURCE *Src = ArcP;
+
+			// Read the stored data of all files of the batch with a single read and decode them from memory,
+			// after a short read the files read their data on their own, so only the files that can not be read fail
+			if (Batch.ReadSize != 0 && ReserveDecodeBuffer(&ReadAhead, Batch.ReadSize) != NULL &&
+				SourceReadAt(ReadAhead.Data, Batch.ReadSize, Batch.ReadPosition, ArcP) == (s64)Batch.ReadSize)
 			{
-				// ディレクトリの場合は再帰をかける
-				DirectoryDecode(NameP, DirP, FileP, Head, (DARC_DIRECTORY *)(DirP + File->DataAddress), ArcP, Key, KeyString, KeyStringBytes, NoKey, KeyStringBuffer);
+				memset(&View, 0, sizeof(DARC_SOURCE));
+				View.Image     = (u8 *)ReadAhead.Data;
+				View.ImageSize = Batch.ReadSize;
+				View.ImageBase = Batch.ReadPosition;
+				Src            = &View;
 			}
-			else
+
+			for (size_t j = Batch.Begin; j < Batch.End; j++)
 			{
-				FILE *DestP;
-				void *Buffer;
+				if (FileDecode(Model, Files[j], Head, Src, Sink, NoKey, CryptCtx, &Buffer) < 0)
+					Failed = true;
+			}
+		}
 
-				// ファイルの場合は展開する
+		free(Buffer.Data);
+		free(ReadAhead.Data);
+	};
 
-				// バッファを確保する
-				Buffer = malloc(DXA_BUFFERSIZE);
-				if (Buffer == NULL) return -1;
+	if (ThreadNum == 1)
+		Worker();
+	else
+	{
+		std::vector<std::thread> Threads;
 
-				// ファイルを開く
-				TCHAR *pName = GetOriginalFileName(NameP + File->NameAddress);
+		for (size_t i = 0; i < ThreadNum; i++)
+			Threads.emplace_back(Worker);
 
-				DestP = _tfopen(pName, TEXT("wb"));
-				// ファイル個別の鍵を作成
-				if (NoKey == false)
-				{
-					KeyStringBufferBytes = CreateKeyFileString((int)Head->CharCodeFormat, KeyString, KeyStringBytes, Dir, File, FileP, DirP, NameP, (BYTE *)KeyStringBuffer);
-					KeyCreate(KeyStringBuffer, KeyStringBufferBytes, lKey);
-				}
+		for (std::thread &Thread : Threads)
+			Thread.join();
+	}
+
+	// 終了
+	return Failed ? -1 : 0;
+}
+
+// Group the files, sorted by data position, into batches of neighbouring small files that are read with a single read
+void DXArchive::CreateDecodeBatches(DARC_HEAD *Head, const std::vector<const DARC_ENTRY *> &Files, bool ReadAhead, std::vector<DARC_DECODEBATCH> *Batches)
+{
+	size_t i = 0;
+
+	Batches->clear();
+
+	while (i < Files.size())
+	{
+		DARC_DECODEBATCH Batch;
+		const u64 Start = Files[i]->DataPosition;
+		u64 End         = Start + GetStoredSize(Head, Files[i]);
+
+		Batch.Begin        = i;
+		Batch.ReadPosition = Start;
+
+		// Files larger than the read-ahead are read directly into their work buffer
+		for (i++; ReadAhead && End - Start <= DXA_READAHEADSIZE && i < Files.size(); i++)
+		{
+			const u64 FileEnd = Files[i]->DataPosition + GetStoredSize(Head, Files[i]);
+
+			if (FileEnd - Start > DXA_READAHEADSIZE) break;
+			if (FileEnd > End) End = FileEnd;
+		}
+
+		Batch.End      = i;
+		Batch.ReadSize = ReadAhead && End - Start <= DXA_READAHEADSIZE ? End - Start : 0;
+
+		Batches->push_back(Batch);
+	}
+}
+
+// Get the number of bytes FileDecode reads from the archive for a file
+u64 DXArchive::GetStoredSize(DARC_HEAD *Head, const DARC_ENTRY *Entry)
+{
+	const u64 HuffSplitSize = Head->HuffmanEncodeKB * 1024 * 2;
+
+	if (Entry->PressDataSize != 0xffffffffffffffff)
+	{
+		if (Entry->HuffPressDataSize != 0xffffffffffffffff)
+		{
+			// Only the beginning and the end of the LZ data are Huffman compressed, the rest is stored behind it
+			if (Head->HuffmanEncodeKB != 0xff && Entry->PressDataSize > HuffSplitSize)
+				return Entry->HuffPressDataSize + Entry->PressDataSize - HuffSplitSize;
+
+			return Entry->HuffPressDataSize;
+		}
+
+		return Entry->PressDataSize;
+	}
+
+	if (Entry->HuffPressDataSize != 0xffffffffffffffff)
+	{
+		if (Head->HuffmanEncodeKB != 0xff && Entry->DataSize > HuffSplitSize)
+			return Entry->HuffPressDataSize + Entry->DataSize - HuffSplitSize;
+
+		return Entry->HuffPressDataSize;
+	}
+
+	return Entry->DataSize;
+}
+
+// Check if a file is extracted with the streaming decoder instead of decoding it as a whole in memory
+bool DXArchive::IsStreamDecode(DARC_HEAD *Head, const DARC_ENTRY *Entry)
+{
+	if (Entry->DataSize < STREAM_MINSIZE) return false;
+
+	// Stored data is already copied in chunks
+	if (Entry->PressDataSize == 0xffffffffffffffff && Entry->HuffPressDataSize == 0xffffffffffffffff) return false;
+
+	// Data Huffman compressed as a whole needs the complete Huffman data in memory
+	if (Entry->HuffPressDataSize != 0xffffffffffffffff)
+	{
+		const u64 HuffSize = Entry->PressDataSize != 0xffffffffffffffff ? Entry->PressDataSize : Entry->DataSize;
+
+		if (Head->HuffmanEncodeKB == 0xff || HuffSize <= Head->HuffmanEncodeKB * 1024 * 2) return false;
+	}
+
+	return true;
+}
+
+// Extract a large compressed file with a bounded amount of memory, the output is written to the sink in chunks
+int DXArchive::FileDecodeStream(const DARC_ENTRY *File, DARC_HEAD *Head, DARC_SOURCE *ArcP, DXArchiveSink *Sink, void *DestP, unsigned char *Key, const DARC_CRYPTCONTEXT *CryptCtx, u8 *Work)
+{
+	DARC_STREAMINPUT In;
+	const u64 HuffKB = Head->HuffmanEncodeKB * 1024;
+	u8 *Window       = Work;
+	u8 *HuffData     = Work + STREAM_WINDOWSIZE + STREAM_INPUTSIZE;
+
+	memset(&In, 0, sizeof(DARC_STREAMINPUT));
+	In.Buffer     = Work + STREAM_WINDOWSIZE;
+	In.BufferSize = STREAM_INPUTSIZE;
+	In.Src        = ArcP;
+	In.Key        = Key;
+	In.CryptCtx   = CryptCtx;
+
+	if (File->HuffPressDataSize != 0xffffffffffffffff)
+	{
+		const u64 Size = File->PressDataSize != 0xffffffffffffffff ? File->PressDataSize : File->DataSize;
+		u8 *HuffOut    = HuffData + File->HuffPressDataSize;
+
+		// ハフマン圧縮されたデータの読み込み、前後の HuffmanEncodeKB だけが圧縮されている
+		if (KeyConvSourceReadAt(HuffData, File->HuffPressDataSize, File->DataPosition, ArcP, Key, File->DataSize, CryptCtx) < 0) return -1;
+		if (Huffman_DecodeChecked(HuffData, File->HuffPressDataSize, HuffOut, HuffKB * 2) != HuffKB * 2) return -1;
+
+		// The middle part is stored as is behind the Huffman data
+		AddStreamSegment(&In, HuffOut, 0, 0, HuffKB);
+		AddStreamSegment(&In, NULL, File->DataPosition + File->HuffPressDataSize, File->DataSize + File->HuffPressDataSize, Size - HuffKB * 2);
+		AddStreamSegment(&In, HuffOut + HuffKB, 0, 0, HuffKB);
+	}
+	else
+		AddStreamSegment(&In, NULL, File->DataPosition, File->DataSize, File->PressDataSize);
+
+	// Not LZ compressed, the stream already is the file data
+	if (File->PressDataSize == 0xffffffffffffffff)
+	{
+		bool FileBegin = true;
+
+		while (StreamFill(&In) != 0)
+		{
+			if (SinkWrite(Sink, DestP, File, In.Buffer + In.Pos, In.End - In.Pos, FileBegin) < 0) return -1;
+
+			In.Pos    = In.End;
+			FileBegin = false;
+		}
+
+		return In.ReadError ? -1 : 0;
+	}
+
+	const int Result = DecodeStream(&In, Sink, DestP, File, Window);
+
+	return In.ReadError ? -1 : Result;
+}
+
+// Add a part of the compressed data to a stream, either from memory ( Data != NULL ) or from the archive
+void DXArchive::AddStreamSegment(DARC_STREAMINPUT *In, const u8 *Data, u64 Position, u64 KeyPosition, u64 Size)
+{
+	DARC_STREAMSEGMENT *Segment = &In->Segment[In->SegmentNum++];
+
+	Segment->Data        = Data;
+	Segment->Position    = Position;
+	Segment->KeyPosition = KeyPosition;
+	Segment->Size        = Size;
+}
+
+// Refill the read buffer of a stream, returns the number of buffered bytes
+u64 DXArchive::StreamFill(DARC_STREAMINPUT *In)
+{
+	// Keep the bytes that were not consumed yet
+	if (In->Pos != 0)
+	{
+		memmove(In->Buffer, In->Buffer + In->Pos, (size_t)(In->End - In->Pos));
+		In->End -= In->Pos;
+		In->Pos = 0;
+	}
+
+	while (In->End < In->BufferSize && In->SegmentIndex < In->SegmentNum)
+	{
+		const DARC_STREAMSEGMENT *Segment = &In->Segment[In->SegmentIndex];
+		u64 Size                          = Segment->Size - In->SegmentRead;
+
+		if (Size > In->BufferSize - In->End) Size = In->BufferSize - In->End;
+
+		if (Segment->Data != NULL)
+			memcpy(In->Buffer + In->End, Segment->Data + In->SegmentRead, (size_t)Size);
+		else if (KeyConvSourceReadAt(In->Buffer + In->End, Size, Segment->Position + In->SegmentRead, In->Src, In->Key, Segment->KeyPosition + In->SegmentRead, In->CryptCtx) < 0)
+		{
+			// End the stream, the caller fails the file
+			In->ReadError    = true;
+			In->SegmentIndex = In->SegmentNum;
+			break;
+		}
+
+		In->End += Size;
+		In->SegmentRead += Size;
+
+		if (In->SegmentRead == Segment->Size)
+		{
+			In->SegmentIndex++;
+			In->SegmentRead = 0;
+		}
+	}
+
+	return In->End - In->Pos;
+}
+
+// Streaming version of Decode, reads the LZ data from a stream and writes the output to the sink in chunks
+// Back references reach at most MAX_POSITION bytes back, so only that much history has to be kept
+int DXArchive::DecodeStream(DARC_STREAMINPUT *In, DXArchiveSink *Sink, void *Handle, const DARC_ENTRY *Entry, u8 *Window)
+{
+	u32 srcsize, destsize, code, indexsize, keycode, conbo, index = 0;
+	u8 *dp, *sp, *WriteP;
+	u64 WindowPosition = 0;
+	bool FileBegin     = true;
+
+	// 解凍後のデータサイズ、圧縮データのサイズとキーコードを得る
+	if (StreamFill(In) < 9) return -1;
+	sp       = In->Buffer + In->Pos;
+	destsize = *((u32 *)&sp[0]);
+	srcsize  = *((u32 *)&sp[4]);
+	keycode  = sp[8];
+	In->Pos += 9;
+
+	if (destsize != Entry->DataSize || srcsize < 9) return -1;
+	srcsize -= 9;
+
+	// 展開開始
+	dp = WriteP = Window;
+	while (srcsize)
+	{
+		// Write the decoded chunk and keep the last MAX_POSITION bytes as history
+		if (dp - Window >= MAX_POSITION + STREAM_CHUNKSIZE)
+		{
+			if (SinkWrite(Sink, Handle, Entry, WriteP, dp - WriteP, FileBegin) < 0) return -1;
+			FileBegin = false;
 
-				delete[] pName;
+			memmove(Window, dp - MAX_POSITION, MAX_POSITION);
+			WindowPosition += (dp - Window) - MAX_POSITION;
+			dp = WriteP = Window + MAX_POSITION;
+		}
+
+		// A code is at most 6 bytes long
+		if (In->End - In->Pos < 6 && StreamFill(In) < (srcsize < 6 ? srcsize : 6)) return -1;
+		sp = In->Buffer + In->Pos;
+
+		// キーコードか同かで処理を分岐
+		if (sp[0] != keycode)
+		{
+			if (WindowPosition + (dp - Window) >= destsize) return -1;
+
+			// 非圧縮コードの場合はそのまま出力
+			*dp = *sp;
+			dp++;
+			In->Pos++;
+			srcsize--;
+			continue;
+		}
+
+		if (srcsize < 2) return -1;
+
+		// キーコードが連続していた場合はキーコード自体を出力
+		if (sp[1] == keycode)
+		{
+			if (WindowPosition + (dp - Window) >= destsize) return -1;
+
+			*dp = (u8)keycode;
+			dp++;
+			In->Pos += 2;
+			srcsize -= 2;
+
+			continue;
+		}
+
+		// 第一バイトを得る
+		code = sp[1];
+
+		// もしキーコードよりも大きな値だった場合はキーコード
+		// とのバッティング防止の為に＋１しているので－１する
+		if (code > keycode) code--;
+
+		sp += 2;
+
+		// 連続長を取得する
+		conbo = code >> 3;
+		if (code & (0x1 << 2))
+		{
+			conbo |= *sp << 5;
+			sp++;
+		}
+		conbo += MIN_COMPRESS; // 保存時に減算した最小圧縮バイト数を足す
+
+		// 参照相対アドレスを取得する
+		indexsize = code & 0x3;
+		if (indexsize == 3) return -1;
+		switch (indexsize)
+		{
+			case 0:
+				index = *sp;
+				sp++;
+				break;
 
-				// データがある場合のみ転送
-				if (File->DataSize != 0)
-				{
-					void *temp;
+			case 1:
+				index = *((u16 *)sp);
+				sp += 2;
+				break;
 
-					// 初期位置をセットする
-					if (_ftelli64(ArcP) != (s32)(Head->DataStartAddress + File->DataAddress))
-						_fseeki64(ArcP, Head->DataStartAddress + File->DataAddress, SEEK_SET);
+			case 2:
+				index = *((u16 *)sp) | (sp[2] << 16);
+				sp += 3;
+				break;
+		}
+		index++; // 保存時に－１しているので＋１する
 
-					// データが圧縮されているかどうかで処理を分岐
-					if (File->PressDataSize != 0xffffffffffffffff)
-					{
-						// 圧縮されている場合
+		// The code must not run past the end of the compressed data
+		if ((u64)(sp - (In->Buffer + In->Pos)) > srcsize) return -1;
+		srcsize -= (u32)(sp - (In->Buffer + In->Pos));
+		In->Pos = sp - In->Buffer;
 
-						// ハフマン圧縮もされているかどうかで処理を分岐
-						if (File->HuffPressDataSize != 0xffffffffffffffff)
-						{
-							// 圧縮データが収まるメモリ領域の確保
-							temp = malloc((size_t)(File->PressDataSize + File->HuffPressDataSize + File->DataSize));
+		// Reject references in front of the window and output past the end of the file
+		if (index > (u64)(dp - Window) || WindowPosition + (dp - Window) + conbo > destsize) return -1;
 
-							// 圧縮データの読み込み
-							KeyConvFileRead(temp, File->HuffPressDataSize, ArcP, NoKey ? NULL : lKey, File->DataSize);
+		// 展開
+		if (index < conbo)
+		{
+			u32 num;
 
-							// ハフマン圧縮を解凍
-							Huffman_Decode(temp, (u8 *)temp + File->HuffPressDataSize);
+			num = index;
+			while (conbo > num)
+			{
+				memcpy(dp, dp - num, num);
+				dp += num;
+				conbo -= num;
+				num += num;
+			}
+			if (conbo != 0)
+			{
+				memcpy(dp, dp - num, conbo);
+				dp += conbo;
+			}
+		}
+		else
+		{
+			memcpy(dp, dp - index, conbo);
+			dp += conbo;
+		}
+	}
 
-							// ファイルの前後をハフマン圧縮している場合は処理を分岐
-							if (Head->HuffmanEncodeKB != 0xff && File->PressDataSize > Head->HuffmanEncodeKB * 1024 * 2)
-							{
-								// 解凍したデータの内、後ろ半分を移動する
-								memmove(
-									(u8 *)temp + File->HuffPressDataSize + File->PressDataSize - Head->HuffmanEncodeKB * 1024,
-									(u8 *)temp + File->HuffPressDataSize + Head->HuffmanEncodeKB * 1024,
-									Head->HuffmanEncodeKB * 1024);
-
-								// 残りのLZ圧縮データを読み込む
-								KeyConvFileRead(
-									(u8 *)temp + File->HuffPressDataSize + Head->HuffmanEncodeKB * 1024,
-									File->PressDataSize - Head->HuffmanEncodeKB * 1024 * 2,
-									ArcP, NoKey ? NULL : lKey, File->DataSize + File->HuffPressDataSize);
-							}
+	if (WindowPosition + (dp - Window) != destsize) return -1;
 
-							// 解凍
-							Decode((u8 *)temp + File->HuffPressDataSize, (u8 *)temp + File->HuffPressDataSize + File->PressDataSize);
+	// 残りを書き出す
+	return SinkWrite(Sink, Handle, Entry, WriteP, dp - WriteP, FileBegin);
+}
 
-							// 書き出し
-							fwrite64((u8 *)temp + File->HuffPressDataSize + File->PressDataSize, File->DataSize, DestP);
+// Get the size of the work memory needed to extract a file
+u64 DXArchive::GetDecodeWorkSize(DARC_HEAD *Head, const DARC_ENTRY *Entry)
+{
+	// Window and read buffer of the streaming decoder plus the Huffman compressed beginning and end
+	if (IsStreamDecode(Head, Entry))
+	{
+		if (Entry->HuffPressDataSize != 0xffffffffffffffff)
+			return STREAM_WINDOWSIZE + STREAM_INPUTSIZE + Entry->HuffPressDataSize + Head->HuffmanEncodeKB * 1024 * 2;
 
-							// メモリの解放
-							free(temp);
-						}
-						else
-						{
-							// 圧縮データが収まるメモリ領域の確保
-							temp = malloc((size_t)(File->PressDataSize + File->DataSize));
+		return STREAM_WINDOWSIZE + STREAM_INPUTSIZE;
+	}
 
-							// 圧縮データの読み込み
-							KeyConvFileRead(temp, File->PressDataSize, ArcP, NoKey ? NULL : lKey, File->DataSize);
+	if (Entry->PressDataSize != 0xffffffffffffffff)
+	{
+		if (Entry->HuffPressDataSize != 0xffffffffffffffff)
+			return Entry->PressDataSize + Entry->HuffPressDataSize + Entry->DataSize;
 
-							// 解凍
-							Decode(temp, (u8 *)temp + File->PressDataSize);
+		return Entry->PressDataSize + Entry->DataSize;
+	}
 
-							// 書き出し
-							fwrite64((u8 *)temp + File->PressDataSize, File->DataSize, DestP);
+	if (Entry->HuffPressDataSize != 0xffffffffffffffff)
+		return Entry->HuffPressDataSize + Entry->DataSize;
 
-							// メモリの解放
-							free(temp);
-						}
-					}
-					else
-					{
-						// 圧縮されていない場合
+	// Uncompressed data is copied in DXA_BUFFERSIZE chunks
+	return Entry->DataSize < DXA_BUFFERSIZE ? Entry->DataSize : DXA_BUFFERSIZE;
+}
 
-						// ハフマン圧縮はされているかどうかで処理を分岐
-						if (File->HuffPressDataSize != 0xffffffffffffffff)
-						{
-							// 圧縮データが収まるメモリ領域の確保
-							temp = malloc((size_t)(File->HuffPressDataSize + File->DataSize));
+// Make sure the work buffer can hold Size bytes, the buffer only ever grows so it stops allocating once it reached the largest entry
+void *DXArchive::ReserveDecodeBuffer(DARC_DECODEBUFFER *Buffer, u64 Size)
+{
+	if (Size <= Buffer->Size && Buffer->Data != NULL)
+		return Buffer->Data;
 
-							// 圧縮データの読み込み
-							KeyConvFileRead(temp, File->HuffPressDataSize, ArcP, NoKey ? NULL : lKey, File->DataSize);
+	free(Buffer->Data);
 
-							// ハフマン圧縮を解凍
-							Huffman_Decode(temp, (u8 *)temp + File->HuffPressDataSize);
+	// Always allocate at least one byte so empty files get a valid buffer as well
+	Buffer->Data = malloc((size_t)(Size != 0 ? Size : 1));
+	Buffer->Size = Buffer->Data != NULL ? Size : 0;
 
-							// ファイルの前後のみハフマン圧縮している場合は処理を分岐
-							if (Head->HuffmanEncodeKB != 0xff && File->DataSize > Head->HuffmanEncodeKB * 1024 * 2)
-							{
-								// 解凍したデータの内、後ろ半分を移動する
-								memmove(
-									(u8 *)temp + File->HuffPressDataSize + File->DataSize - Head->HuffmanEncodeKB * 1024,
-									(u8 *)temp + File->HuffPressDataSize + Head->HuffmanEncodeKB * 1024,
-									Head->HuffmanEncodeKB * 1024);
-
-								// 残りのデータを読み込む
-								KeyConvFileRead(
-									(u8 *)temp + File->HuffPressDataSize + Head->HuffmanEncodeKB * 1024,
-									File->DataSize - Head->HuffmanEncodeKB * 1024 * 2,
-									ArcP, NoKey ? NULL : lKey, File->DataSize + File->HuffPressDataSize);
-							}
+	return Buffer->Data;
+}
 
-							// 書き出し
-							fwrite64((u8 *)temp + File->HuffPressDataSize, File->DataSize, DestP);
+// Write decoded data of an entry to the sink, the anti-unpack banner is dropped from the beginning of protected files
+int DXArchive::SinkWrite(DXArchiveSink *Sink, void *Handle, const DARC_ENTRY *Entry, void *Data, u64 Size, bool FileBegin)
+{
+	if (FileBegin && Entry->AntiUnpack && Size >= sizeof(AntiUnpackData) && memcmp(Data, AntiUnpackData, sizeof(AntiUnpackData)) == 0)
+	{
+		Data = (u8 *)Data + sizeof(AntiUnpackData);
+		Size -= sizeof(AntiUnpackData);
+	}
 
-							// メモリの解放
-							free(temp);
-						}
-						else
-						{
-							u64 MoveSize, WriteSize;
+	return Sink->Write(Handle, Data, Size);
+}
 
-							// 転送処理開始
-							WriteSize = 0;
-							while (WriteSize < File->DataSize)
-							{
-								MoveSize = File->DataSize - WriteSize > DXA_BUFFERSIZE ? DXA_BUFFERSIZE : File->DataSize - WriteSize;
+// Check if a file can carry the anti-unpack banner
+bool DXArchive::IsAntiUnpackFile(const TCHAR *FileName)
+{
+	for (const TCHAR *ProtectedName : AntiUnpackFileNames)
+	{
+		if (_tcsicmp(FileName, ProtectedName) == 0)
+			return true;
+	}
 
-								// ファイルの反転読み込み
-								KeyConvFileRead(Buffer, MoveSize, ArcP, NoKey ? NULL : lKey, File->DataSize + WriteSize);
+	return false;
+}
 
-								// 書き出し
-								fwrite64(Buffer, MoveSize, DestP);
+// Extract a single file into the sink, only reads from the archive source at explicit positions so it can run on multiple threads
+int DXArchive::FileDecode(const DARC_ARCHIVEMODEL *Model, const DARC_ENTRY *File, DARC_HEAD *Head, DARC_SOURCE *ArcP, DXArchiveSink *Sink, bool NoKey, const DARC_CRYPTCONTEXT *CryptCtx, DARC_DECODEBUFFER *Buffer)
+{
+	u8 Key[DXA_KEY_BYTES];
+	unsigned char *lKey = NoKey ? NULL : Key;
+	void *DestP;
+	void *temp;
+	s64 DataPos;
+	int Result = 0;
 
-								WriteSize += MoveSize;
-							}
-						}
-					}
-				}
+	// Work memory for the compressed and decompressed data, reused between the files of a worker
+	temp = ReserveDecodeBuffer(Buffer, GetDecodeWorkSize(Head, File));
+	if (temp == NULL) return -1;
 
-				// ファイルを閉じる
-				fclose(DestP);
+	memcpy(Key, File->Key, DXA_KEY_BYTES);
 
-				// バッファを開放する
-				free(Buffer);
+	// ファイルを開く
+	DestP = Sink->BeginFile(GetEntryPath(Model, File), File->DataSize);
+	if (DestP == NULL) return -1;
 
-				//////////////////////////////
-				///// Remove Unpack Protection
-				const std::vector<std::wstring> UNPACK_PROTECTION_FILES = { L"game.dat", L"cdatabase.dat", L"database.dat", L"commonevent.dat" };
-				const uint8_t ANTI_UNPACK_DATA[62]                      = { 0x45, 0x78, 0x74, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6E, 0x67, 0x20, 0x64, 0x61, 0x74, 0x61, 0x20, 0x66, 0x72, 0x6F, 0x6D, 0x20, 0x65, 0x6E, 0x63, 0x72, 0x79, 0x70, 0x74, 0x65, 0x64, 0x20, 0x66, 0x69, 0x6C, 0x65, 0x73, 0x20, 0x76, 0x69, 0x6F, 0x6C, 0x61, 0x74, 0x65, 0x73, 0x20, 0x74, 0x68, 0x65, 0x20, 0x67, 0x75, 0x69, 0x64, 0x65, 0x6C, 0x69, 0x6E, 0x65, 0x73, 0x2E, 0x00 };
-				const uint32_t ANTI_UNPACK_DATA_SIZE                    = 62;
+	// Large compressed files are decoded with a bounded window
+	if (IsStreamDecode(Head, File))
+	{
+		if (FileDecodeStream(File, Head, ArcP, Sink, DestP, lKey, CryptCtx, (u8 *)temp) < 0) Result = -1;
+	}
+	// データがある場合のみ転送
+	else if (File->DataSize != 0)
+	{
+		// 初期位置をセットする
+		DataPos = File->DataPosition;
 
-				pName = GetOriginalFileName(NameP + File->NameAddress);
+		// データが圧縮されているかどうかで処理を分岐
+		if (File->PressDataSize != 0xffffffffffffffff)
+		{
+			// 圧縮されている場合
 
-				std::wstring fileName = std::wstring(pName);
-				std::transform(fileName.begin(), fileName.end(), fileName.begin(), ::tolower);
+			// ハフマン圧縮もされているかどうかで処理を分岐
+			if (File->HuffPressDataSize != 0xffffffffffffffff)
+			{
+				// 圧縮データの読み込み
+				const u8 *HuffData = KeyConvSourceFetch(temp, File->HuffPressDataSize, DataPos, ArcP, lKey, File->DataSize, CryptCtx);
+				const bool HuffSplit = Head->HuffmanEncodeKB != 0xff && File->PressDataSize > Head->HuffmanEncodeKB * 1024 * 2;
+				const u64 HuffSize   = HuffSplit ? Head->HuffmanEncodeKB * 1024 * 2 : File->PressDataSize;
 
-				// As I am not sure if the file name will contain only the actual file name or also a directory
-				// check if the file name ends with any of the unpack protection files
-				bool isUnpackProtectionFile = false;
+				// ハフマン圧縮を解凍
+				if (HuffData == NULL || Huffman_DecodeChecked(HuffData, File->HuffPressDataSize, (u8 *)temp + File->HuffPressDataSize, HuffSize) != HuffSize) Result = -1;
 
-				for (const std::wstring &unpackProtectionFile : UNPACK_PROTECTION_FILES)
+				// ファイルの前後をハフマン圧縮している場合は処理を分岐
+				if (Result == 0 && HuffSplit)
 				{
-					if (fileName.ends_with(unpackProtectionFile))
-					{
-						isUnpackProtectionFile = true;
-						break;
-					}
+					// 解凍したデータの内、後ろ半分を移動する
+					memmove(
+						(u8 *)temp + File->HuffPressDataSize + File->PressDataSize - Head->HuffmanEncodeKB * 1024,
+						(u8 *)temp + File->HuffPressDataSize + Head->HuffmanEncodeKB * 1024,
+						Head->HuffmanEncodeKB * 1024);
+
+					// 残りのLZ圧縮データを読み込む
+					if (KeyConvSourceReadAt(
+							(u8 *)temp + File->HuffPressDataSize + Head->HuffmanEncodeKB * 1024,
+							File->PressDataSize - Head->HuffmanEncodeKB * 1024 * 2,
+							DataPos + File->HuffPressDataSize, ArcP, lKey, File->DataSize + File->HuffPressDataSize, CryptCtx) < 0) Result = -1;
 				}
 
-				if (isUnpackProtectionFile)
-				{
-					DestP = _tfopen(pName, TEXT("rb"));
-
-					// Get the file size
-					_fseeki64(DestP, 0, SEEK_END);
-					int64_t fileSize = _ftelli64(DestP);
-
-					if (fileSize >= ANTI_UNPACK_DATA_SIZE)
-					{
-						// Check if the file begins with the anti-unpack data
-						_fseeki64(DestP, 0, SEEK_SET);
-
-						void *pFileBeginning = malloc(ANTI_UNPACK_DATA_SIZE);
-						fread64(pFileBeginning, ANTI_UNPACK_DATA_SIZE, DestP);
-
-						if (pFileBeginning && std::memcmp(pFileBeginning, ANTI_UNPACK_DATA, ANTI_UNPACK_DATA_SIZE) == 0)
-						{
-							fileSize -= ANTI_UNPACK_DATA_SIZE;
+				// 解凍
+				if (Result == 0 && DecodeChecked((u8 *)temp + File->HuffPressDataSize, File->PressDataSize, (u8 *)temp + File->HuffPressDataSize + File->PressDataSize, File->DataSize) != (s64)File->DataSize) Result = -1;
 
-							// Remove the first 62 bytes from the file
-							_fseeki64(DestP, ANTI_UNPACK_DATA_SIZE, SEEK_SET);
+				// 書き出し
+				if (Result == 0 && SinkWrite(Sink, DestP, File, (u8 *)temp + File->HuffPressDataSize + File->PressDataSize, File->DataSize, true) < 0) Result = -1;
+			}
+			else
+			{
+				// 圧縮データの読み込み
+				const u8 *PressData = KeyConvSourceFetch(temp, File->PressDataSize, DataPos, ArcP, lKey, File->DataSize, CryptCtx);
 
-							std::vector<uint8_t> buffer(fileSize);
-							fread64(buffer.data(), fileSize, DestP);
-							fclose(DestP);
+				// 解凍
+				if (PressData == NULL || DecodeChecked(PressData, File->PressDataSize, (u8 *)temp + File->PressDataSize, File->DataSize) != (s64)File->DataSize) Result = -1;
 
-							DestP = _tfopen(pName, TEXT("wb"));
+				// 書き出し
+				else if (SinkWrite(Sink, DestP, File, (u8 *)temp + File->PressDataSize, File->DataSize, true) < 0) Result = -1;
+			}
+		}
+		else
+		{
+			// 圧縮されていない場合
 
-							fwrite64(buffer.data(), fileSize, DestP);
-						}
+			// ハフマン圧縮はされているかどうかで処理を分岐
+			if (File->HuffPressDataSize != 0xffffffffffffffff)
+			{
+				// 圧縮データの読み込み
+				const u8 *HuffData = KeyConvSourceFetch(temp, File->HuffPressDataSize, DataPos, ArcP, lKey, File->DataSize, CryptCtx);
+				const bool HuffSplit = Head->HuffmanEncodeKB != 0xff && File->DataSize > Head->HuffmanEncodeKB * 1024 * 2;
+				const u64 HuffSize   = HuffSplit ? Head->HuffmanEncodeKB * 1024 * 2 : File->DataSize;
 
-						free(pFileBeginning);
-					}
+				// ハフマン圧縮を解凍
+				if (HuffData == NULL || Huffman_DecodeChecked(HuffData, File->HuffPressDataSize, (u8 *)temp + File->HuffPressDataSize, HuffSize) != HuffSize) Result = -1;
 
-					fclose(DestP);
+				// ファイルの前後のみハフマン圧縮している場合は処理を分岐
+				if (Result == 0 && HuffSplit)
+				{
+					// 解凍したデータの内、後ろ半分を移動する
+					memmove(
+						(u8 *)temp + File->HuffPressDataSize + File->DataSize - Head->HuffmanEncodeKB * 1024,
+						(u8 *)temp + File->HuffPressDataSize + Head->HuffmanEncodeKB * 1024,
+						Head->HuffmanEncodeKB * 1024);
+
+					// 残りのデータを読み込む
+					if (KeyConvSourceReadAt(
+							(u8 *)temp + File->HuffPressDataSize + Head->HuffmanEncodeKB * 1024,
+							File->DataSize - Head->HuffmanEncodeKB * 1024 * 2,
+							DataPos + File->HuffPressDataSize, ArcP, lKey, File->DataSize + File->HuffPressDataSize, CryptCtx) < 0) Result = -1;
 				}
 
-				delete[] pName;
-
-				///// Remove Unpack Protection
-				//////////////////////////////
+				// 書き出し
+				if (Result == 0 && SinkWrite(Sink, DestP, File, (u8 *)temp + File->HuffPressDataSize, File->DataSize, true) < 0) Result = -1;
+			}
+			else
+			{
+				u64 MoveSize, WriteSize;
 
-				// ファイルのタイムスタンプを設定する
+				// 転送処理開始
+				WriteSize = 0;
+				while (WriteSize < File->DataSize)
 				{
-					HANDLE HFile;
-					FILETIME CreateTime, LastAccessTime, LastWriteTime;
-					TCHAR *pName = GetOriginalFileName(NameP + File->NameAddress);
-					HFile        = CreateFile(pName,
-											  GENERIC_WRITE, 0, NULL,
-											  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-					delete[] pName;
-
-					if (HFile == INVALID_HANDLE_VALUE)
+					MoveSize = File->DataSize - WriteSize > DXA_BUFFERSIZE ? DXA_BUFFERSIZE : File->DataSize - WriteSize;
+
+					// ファイルの反転読み込み
+					const u8 *Data = KeyConvSourceFetch(temp, MoveSize, DataPos + WriteSize, ArcP, lKey, File->DataSize + WriteSize, CryptCtx);
+
+					// 書き出し
+					if (Data == NULL || SinkWrite(Sink, DestP, File, (void *)Data, MoveSize, WriteSize == 0) < 0)
 					{
-						HFile = HFile;
+						Result = -1;
+						break;
 					}
 
-					CreateTime.dwHighDateTime     = (u32)(File->Time.Create >> 32);
-					CreateTime.dwLowDateTime      = (u32)(File->Time.Create & 0xffffffffffffffff);
-					LastAccessTime.dwHighDateTime = (u32)(File->Time.LastAccess >> 32);
-					LastAccessTime.dwLowDateTime  = (u32)(File->Time.LastAccess & 0xffffffffffffffff);
-					LastWriteTime.dwHighDateTime  = (u32)(File->Time.LastWrite >> 32);
-					LastWriteTime.dwLowDateTime   = (u32)(File->Time.LastWrite & 0xffffffffffffffff);
-					SetFileTime(HFile, &CreateTime, &LastAccessTime, &LastWriteTime);
-					CloseHandle(HFile);
+					WriteSize += MoveSize;
 				}
-
-				// ファイル属性を付ける
-				pName = GetOriginalFileName(NameP + File->NameAddress);
-				SetFileAttributes(pName, (u32)File->Attributes & ~(FILE_ATTRIBUTE_SYSTEM | FILE_ATTRIBUTE_HIDDEN));
-				delete[] pName;
 			}
 		}
 	}
 
-	// カレントディレクトリを元に戻す
-	SetCurrentDirectory(DirPath);
+	// ファイルを閉じる
+	if (Sink->EndFile(DestP, File) < 0) Result = -1;
 
 	// 終了
-	return 0;
+	return Result;
 }
 
 // ディレクトリ内のファイルパスを取得する
@@ -1880,18 +2747,30 @@ int DXArchive::Encode(void *Src, u32 SrcSize, void *Dest, bool OutStatus, bool M
 
 // デコード( 戻り値:解凍後のサイズ  -1 はエラー  Dest に NULL を入れることも可能 )
 int DXArchive::Decode(void *Src, void *Dest)
+{
+	return (int)DecodeChecked(Src, ~0ULL, Dest, ~0ULL);
+}
+
+// Bounds checked version of Decode, every read stays inside the SrcSize bytes of Src and every write and back reference inside the DestSize bytes of Dest
+// Damaged or crafted data makes it fail instead of crashing ( return value:size of the decoded data  -1:error  Dest can be NULL )
+s64 DXArchive::DecodeChecked(const void *Src, u64 SrcSize, void *Dest, u64 DestSize)
 {
 	u32 srcsize, destsize, code, indexsize, keycode, conbo, index = 0;
-	u8 *srcp, *destp, *dp, *sp;
+	const u8 *srcp, *sp, *send;
+	u8 *destp, *dp, *dend;
 
 	destp = (u8 *)Dest;
-	srcp  = (u8 *)Src;
+	srcp  = (const u8 *)Src;
+
+	if (SrcSize < 9) return -1;
 
 	// 解凍後のデータサイズを得る
 	destsize = *((u32 *)&srcp[0]);
 
 	// 圧縮データのサイズを得る
-	srcsize = *((u32 *)&srcp[4]) - 9;
+	srcsize = *((u32 *)&srcp[4]);
+	if (srcsize < 9 || srcsize > SrcSize) return -1;
+	srcsize -= 9;
 
 	// キーコード
 	keycode = srcp[8];
@@ -1900,29 +2779,35 @@ int DXArchive::Decode(void *Src, void *Dest)
 	if (Dest == NULL)
 		return destsize;
 
+	if (destsize > DestSize) return -1;
+
 	// 展開開始
-	sp = srcp + 9;
-	dp = destp;
-	while (srcsize)
+	sp   = srcp + 9;
+	send = sp + srcsize;
+	dp   = destp;
+	dend = destp + destsize;
+	while (sp < send)
 	{
 		// キーコードか同かで処理を分岐
 		if (sp[0] != keycode)
 		{
 			// 非圧縮コードの場合はそのまま出力
+			if (dp == dend) return -1;
 			*dp = *sp;
 			dp++;
 			sp++;
-			srcsize--;
 			continue;
 		}
 
+		if (send - sp < 2) return -1;
+
 		// キーコードが連続していた場合はキーコード自体を出力
 		if (sp[1] == keycode)
 		{
+			if (dp == dend) return -1;
 			*dp = (u8)keycode;
 			dp++;
 			sp += 2;
-			srcsize -= 2;
 
 			continue;
 		}
@@ -1935,42 +2820,42 @@ int DXArchive::Decode(void *Src, void *Dest)
 		if (code > keycode) code--;
 
 		sp += 2;
-		srcsize -= 2;
 
 		// 連続長を取得する
 		conbo = code >> 3;
 		if (code & (0x1 << 2))
 		{
+			if (sp == send) return -1;
 			conbo |= *sp << 5;
 			sp++;
-			srcsize--;
 		}
 		conbo += MIN_COMPRESS; // 保存時に減算した最小圧縮バイト数を足す
 
 		// 参照相対アドレスを取得する
 		indexsize = code & 0x3;
+		if (indexsize == 3 || send - sp < (s64)indexsize + 1) return -1;
 		switch (indexsize)
 		{
 			case 0:
 				index = *sp;
 				sp++;
-				srcsize--;
 				break;
 
 			case 1:
 				index = *((u16 *)sp);
 				sp += 2;
-				srcsize -= 2;
 				break;
 
 			case 2:
 				index = *((u16 *)sp) | (sp[2] << 16);
 				sp += 3;
-				srcsize -= 3;
 				break;
 		}
 		index++; // 保存時に－１しているので＋１する
 
+		// The reference has to point into the data decoded so far and the copy has to fit into the output
+		if (index > (u64)(dp - destp) || conbo > (u64)(dend - dp)) return -1;
+
 		// 展開
 		if (index < conbo)
 		{
@@ -1997,44 +2882,40 @@ int DXArchive::Decode(void *Src, void *Dest)
 		}
 	}
 
+	// The data has to fill the output exactly
+	if (dp != dend) return -1;
+
 	// 解凍後のサイズを返す
-	return (int)destsize;
+	return destsize;
 }
 
-// バイナリデータを元に CRC32 のハッシュ値を計算する
-u32 DXArchive::HashCRC32(const void *SrcData, size_t SrcDataSize)
+// CRC32 のテーブルを作成する、done at compile time because KeyCreate runs on several threads at once while probing and extracting
+static constexpr std::array<u32, 256> CreateCRC32Table(void)
 {
-	static DWORD CRC32Table[256];
-	static int CRC32TableInit = 0;
-	DWORD CRC                 = 0xffffffff;
-	BYTE *SrcByte             = (BYTE *)SrcData;
-	DWORD i;
+	std::array<u32, 256> Table = {};
+	const u32 Magic            = 0xedb88320; // 0x4c11db7 をビットレベルで順番を逆にしたものが 0xedb88320
 
-	// テーブルが初期化されていなかったら初期化する
-	if (CRC32TableInit == 0)
+	for (u32 i = 0; i < 256; i++)
 	{
-		DWORD Magic = 0xedb88320; // 0x4c11db7 をビットレベルで順番を逆にしたものが 0xedb88320
-		DWORD j;
-
-		for (i = 0; i < 256; i++)
-		{
-			DWORD Data = i;
-			for (j = 0; j < 8; j++)
-			{
-				int b = (Data & 1);
-				Data >>= 1;
-				if (b != 0)
-				{
-					Data ^= Magic;
-				}
-			}
-			CRC32Table[i] = Data;
-		}
+		u32 Data = i;
+		for (u32 j = 0; j < 8; j++)
+			Data = (Data & 1) != 0 ? (Data >> 1) ^ Magic : Data >> 1;
 
-		// テーブルを初期化したフラグを立てる
-		CRC32TableInit = 1;
+		Table[i] = Data;
 	}
 
+	return Table;
+}
+
+static constexpr std::array<u32, 256> CRC32Table = CreateCRC32Table();
+
+// バイナリデータを元に CRC32 のハッシュ値を計算する
+u32 DXArchive::HashCRC32(const void *SrcData, size_t SrcDataSize)
+{
+	DWORD CRC     = 0xffffffff;
+	BYTE *SrcByte = (BYTE *)SrcData;
+	size_t i;
+
 	for (i = 0; i < SrcDataSize; i++)
 	{
 		CRC = CRC32Table[(BYTE)(CRC ^ SrcByte[i])] ^ (CRC >> 8);
@@ -2098,6 +2979,7 @@ int DXArchive::EncodeArchive(const TCHAR *OutputFileName, const std::vector<std:
 	size_t KeyStringBytes;
 	char KeyStringBuffer[DXA_KEY_STRING_MAXLENGTH];
 	DARC_ENCODEINFO EncodeInfo;
+	DARC_CRYPTCONTEXT CryptCtx;
 
 	// 状況出力を行う場合はファイルの総数を数える
 	EncodeInfo.CompFileNum  = 0;
@@ -2160,34 +3042,18 @@ int DXArchive::EncodeArchive(const TCHAR *OutputFileName, const std::vector<std:
 	// 出力ファイルを開く
 	DestFp = _tfopen(OutputFileName, TEXT("wb+"));
 
-	g_cryptVersion = cryptVersion;
-	g_newCrypt     = (cryptVersion >= 331 && cryptVersion < 1000 || cryptVersion >= 1010);
-	g_chacha20     = cryptVersion == 0x64 || cryptVersion == 0xC8;
-
-	if (cryptVersion == 0xC8)
-	{
-		std::array<uint8_t, 4> data;
-		std::array<uint8_t, 64> key;
-
-		std::memcpy(data.data(), (uint8_t *)KeyString_ + KeyStringBytes + 1, 4);
-		wolf::crypt::chacha20::keySetup(data, key);
-
-		std::memcpy(g_cc20Key, key.data(), 32);
-		std::memcpy(g_cc20Nonce, key.data() + 34, 12);
-	}
+	InitCryptContext(&CryptCtx, cryptVersion, KeyString_, KeyStringBytes);
 
 	uint8_t *pK2 = nullptr;
 
-	if (g_newCrypt)
+	if (CryptCtx.NewCrypt)
 	{
 		memset(&Head, 0, sizeof(Head));
 
-		memset(g_specialKey, 0, 768);
-
 		if (cryptVersion >= 1010)
 			pK2 = (uint8_t *)KeyString_ + KeyStringBytes + 1;
 
-		wolf::crypt::initWolfCrypt(cryptVersion, Head.Reserve, g_specialKey, pK2);
+		wolf::crypt::initWolfCrypt(cryptVersion, Head.Reserve, CryptCtx.SpecialKey, pK2);
 	}
 
 	// アーカイブのヘッダを出力する
@@ -2207,7 +3073,7 @@ int DXArchive::EncodeArchive(const TCHAR *OutputFileName, const std::vector<std:
 		if (Press == false) Head.Flags |= DXA_FLAG_NO_HEAD_PRESS;
 		SetFileApisToANSI();
 
-		KeyConvFileWrite(&Head, sizeof(DARC_HEAD), DestFp, NoKey ? NULL : Key, 0);
+		KeyConvFileWrite(&Head, sizeof(DARC_HEAD), DestFp, NoKey ? NULL : Key, 0, &CryptCtx);
 	}
 
 	// 各バッファを確保する
@@ -2271,7 +3137,7 @@ int DXArchive::EncodeArchive(const TCHAR *OutputFileName, const std::vector<std:
 		if ((Type & FILE_ATTRIBUTE_DIRECTORY) != 0)
 		{
 			// ディレクトリの場合はディレクトリのアーカイブに回す
-			DirectoryEncode((int)Head.CharCodeFormat, const_cast<wchar_t *>(FileOrDirectoryPath[i].c_str()), NameP, DirP, FileP, &Directory, &SizeSave, i, DestFp, TempBuffer, Press, MaxPress, AlwaysHuffman, HuffmanEncodeKB, KeyString, KeyStringBytes, NoKey, KeyStringBuffer, &EncodeInfo);
+			DirectoryEncode((int)Head.CharCodeFormat, const_cast<wchar_t *>(FileOrDirectoryPath[i].c_str()), NameP, DirP, FileP, &Directory, &SizeSave, i, DestFp, TempBuffer, Press, MaxPress, AlwaysHuffman, HuffmanEncodeKB, KeyString, KeyStringBytes, NoKey, KeyStringBuffer, &EncodeInfo, &CryptCtx);
 		}
 		else
 		{
@@ -2456,7 +3322,7 @@ int DXArchive::EncodeArchive(const TCHAR *OutputFileName, const std::vector<std:
 
 							// 圧縮データに鍵を適用して書き出す
 							WriteSize = (File.HuffPressDataSize + 3) / 4 * 4; // サイズは４の倍数に合わせる
-							KeyConvFileWrite(HuffData, WriteSize, DestFp, NoKey ? NULL : lKey, File.DataSize);
+							KeyConvFileWrite(HuffData, WriteSize, DestFp, NoKey ? NULL : lKey, File.DataSize, &CryptCtx);
 						}
 						else
 						{
@@ -2469,12 +3335,12 @@ int DXArchive::EncodeArchive(const TCHAR *OutputFileName, const std::vector<std:
 							File.HuffPressDataSize = Huffman_Encode(HuffData, HuffmanEncodeKB * 1024 * 2, HuffData + HuffmanEncodeKB * 1024 * 2);
 
 							// ハフマン圧縮した部分を書き出す
-							KeyConvFileWrite(HuffData + HuffmanEncodeKB * 1024 * 2, File.HuffPressDataSize, DestFp, NoKey ? NULL : lKey, File.DataSize);
+							KeyConvFileWrite(HuffData + HuffmanEncodeKB * 1024 * 2, File.HuffPressDataSize, DestFp, NoKey ? NULL : lKey, File.DataSize, &CryptCtx);
 
 							// ハフマン圧縮していない箇所を書き出す
 							WriteSize = File.HuffPressDataSize + DestSize - HuffmanEncodeKB * 1024 * 2;
 							WriteSize = (WriteSize + 3) / 4 * 4; // サイズは４の倍数に合わせる
-							KeyConvFileWrite((u8 *)DestBuf + HuffmanEncodeKB * 1024, WriteSize - File.HuffPressDataSize, DestFp, NoKey ? NULL : lKey, File.DataSize + File.HuffPressDataSize);
+							KeyConvFileWrite((u8 *)DestBuf + HuffmanEncodeKB * 1024, WriteSize - File.HuffPressDataSize, DestFp, NoKey ? NULL : lKey, File.DataSize + File.HuffPressDataSize, &CryptCtx);
 						}
 
 						// メモリの解放
@@ -2484,7 +3350,7 @@ int DXArchive::EncodeArchive(const TCHAR *OutputFileName, const std::vector<std:
 					{
 						// 圧縮データを反転して書き出す
 						WriteSize = (DestSize + 3) / 4 * 4; // サイズは４の倍数に合わせる
-						KeyConvFileWrite(DestBuf, WriteSize, DestFp, NoKey ? NULL : lKey, File.DataSize);
+						KeyConvFileWrite(DestBuf, WriteSize, DestFp, NoKey ? NULL : lKey, File.DataSize, &CryptCtx);
 					}
 
 					// メモリの解放
@@ -2515,7 +3381,7 @@ int DXArchive::EncodeArchive(const TCHAR *OutputFileName, const std::vector<std:
 
 							// 圧縮データに鍵を適用して書き出す
 							WriteSize = (File.HuffPressDataSize + 3) / 4 * 4; // サイズは４の倍数に合わせる
-							KeyConvFileWrite(HuffData, WriteSize, DestFp, NoKey ? NULL : lKey, File.DataSize);
+							KeyConvFileWrite(HuffData, WriteSize, DestFp, NoKey ? NULL : lKey, File.DataSize, &CryptCtx);
 						}
 						else
 						{
@@ -2528,12 +3394,12 @@ int DXArchive::EncodeArchive(const TCHAR *OutputFileName, const std::vector<std:
 							File.HuffPressDataSize = Huffman_Encode(HuffData, HuffmanEncodeKB * 1024 * 2, HuffData + HuffmanEncodeKB * 1024 * 2);
 
 							// ハフマン圧縮した部分を書き出す
-							KeyConvFileWrite(HuffData + HuffmanEncodeKB * 1024 * 2, File.HuffPressDataSize, DestFp, NoKey ? NULL : lKey, File.DataSize);
+							KeyConvFileWrite(HuffData + HuffmanEncodeKB * 1024 * 2, File.HuffPressDataSize, DestFp, NoKey ? NULL : lKey, File.DataSize, &CryptCtx);
 
 							// ハフマン圧縮していない箇所を書き出す
 							WriteSize = File.HuffPressDataSize + FileSize - HuffmanEncodeKB * 1024 * 2;
 							WriteSize = (WriteSize + 3) / 4 * 4; // サイズは４の倍数に合わせる
-							KeyConvFileWrite(SrcBuf + HuffmanEncodeKB * 1024, WriteSize - File.HuffPressDataSize, DestFp, NoKey ? NULL : lKey, File.DataSize + File.HuffPressDataSize);
+							KeyConvFileWrite(SrcBuf + HuffmanEncodeKB * 1024, WriteSize - File.HuffPressDataSize, DestFp, NoKey ? NULL : lKey, File.DataSize + File.HuffPressDataSize, &CryptCtx);
 						}
 
 						// メモリの解放
@@ -2552,7 +3418,7 @@ int DXArchive::EncodeArchive(const TCHAR *OutputFileName, const std::vector<std:
 
 							// ファイルの鍵適用読み込み
 							memset(TempBuffer, 0, (size_t)MoveSize);
-							KeyConvFileRead(TempBuffer, MoveSize, SrcP, NoKey ? NULL : lKey, File.DataSize + WriteSize);
+							KeyConvFileRead(TempBuffer, MoveSize, SrcP, NoKey ? NULL : lKey, File.DataSize + WriteSize, &CryptCtx);
 
 							// 書き出し
 							fwrite64(TempBuffer, MoveSize, DestFp);
@@ -2609,7 +3475,7 @@ int DXArchive::EncodeArchive(const TCHAR *OutputFileName, const std::vector<std:
 			HeaderHuffDataSize = Huffman_Encode(PressData, (u64)LZDataSize, PressData + TotalSize * 2 + 32);
 
 			// 纏めたものに鍵を適用して出力
-			KeyConvFileWrite(PressData + TotalSize * 2 + 32, HeaderHuffDataSize, DestFp, NoKey ? NULL : Key, 0);
+			KeyConvFileWrite(PressData + TotalSize * 2 + 32, HeaderHuffDataSize, DestFp, NoKey ? NULL : Key, 0, &CryptCtx);
 
 			// メモリの解放
 			free(PressData);
@@ -2617,7 +3483,7 @@ int DXArchive::EncodeArchive(const TCHAR *OutputFileName, const std::vector<std:
 		else
 		{
 			// 纏めたものに鍵を適用して出力
-			KeyConvFileWrite(PressSource, TotalSize, DestFp, NoKey ? NULL : Key, 0);
+			KeyConvFileWrite(PressSource, TotalSize, DestFp, NoKey ? NULL : Key, 0, &CryptCtx);
 		}
 
 		// メモリの解放
@@ -2638,7 +3504,7 @@ int DXArchive::EncodeArchive(const TCHAR *OutputFileName, const std::vector<std:
 		fwrite64(&Head, sizeof(DARC_HEAD), DestFp);
 	}
 
-	if (g_newCrypt)
+	if (CryptCtx.NewCrypt)
 	{
 		uint8_t roundKey[wolf::crypt::aes::ROUND_KEY_SIZE] = { 0 };
 
@@ -2683,7 +3549,7 @@ int DXArchive::EncodeArchive(const TCHAR *OutputFileName, const std::vector<std:
 		wolf::crypt::aes::aesCtrXCrypt(pFileData + 64, roundKey, bodySize);
 		wolf::crypt::aes::aesCtrXCrypt(pFileData + Head.FileNameTableStartAddress, roundKey, size - static_cast<int32_t>(Head.FileNameTableStartAddress));
 
-		wolf::crypt::initWolfCrypt(cryptVersion, pPwd, g_specialKey, nullptr, pFileData, 64, size - 64, true, KeyString_);
+		wolf::crypt::initWolfCrypt(cryptVersion, pPwd, CryptCtx.SpecialKey, nullptr, pFileData, 64, size - 64, true, KeyString_);
 
 		wolf::crypt::cryptAddresses(pFileData, pPwd, cryptVersion);
 
@@ -2711,17 +3577,67 @@ int DXArchive::EncodeArchive(const TCHAR *OutputFileName, const std::vector<std:
 
 // アーカイブファイルを展開する
 int DXArchive::DecodeArchive(TCHAR *ArchiveName, const TCHAR *OutputPath, const char *KeyString_)
+{
+	DXArchiveFileSystemSink Sink(OutputPath);
+
+	return DecodeArchiveToSink(ArchiveName, &Sink, KeyString_);
+}
+
+// Extract an archive into the given sink, without options all entries are extracted with one thread per hardware thread
+int DXArchive::DecodeArchiveToSink(TCHAR *ArchiveName, DXArchiveSink *Sink, const char *KeyString_, const DARC_DECODEOPTIONS *Options)
+{
+	const DARC_DECODEOPTIONS DefaultOptions = {};
+	DARC_DECODEARCHIVE Archive;
+	int Result;
+
+	if (DecodeArchiveOpen(ArchiveName, KeyString_, &Archive) < 0) return -1;
+
+	// アーカイブの展開を開始する
+	Result = DirectoryDecode(&Archive.Head, &Archive.Model, Sink, &Archive.Src, Archive.NoKey, &Archive.CryptCtx, Options != NULL ? Options : &DefaultOptions);
+
+	DecodeArchiveClose(&Archive);
+
+	// 終了
+	return Result < 0 ? -1 : 0;
+}
+
+// Read the entry list of an archive without extracting anything, only the header is decrypted and decompressed
+int DXArchive::ListArchive(TCHAR *ArchiveName, DARC_ARCHIVEMODEL *Model, const char *KeyString_)
+{
+	DARC_DECODEARCHIVE Archive;
+
+	if (DecodeArchiveOpen(ArchiveName, KeyString_, &Archive) < 0) return -1;
+
+	*Model = std::move(Archive.Model);
+
+	DecodeArchiveClose(&Archive);
+
+	// 終了
+	return 0;
+}
+
+// Check if the key fits the archive, opening it already decodes the header and checks the size of the LZ compressed header and the tables
+int DXArchive::ProbeArchive(TCHAR *ArchiveName, const char *KeyString_)
+{
+	DARC_ARCHIVEMODEL Model;
+
+	return ListArchive(ArchiveName, &Model, KeyString_);
+}
+
+// Open an archive for extraction, reads and decodes the header and builds the entry model
+int DXArchive::DecodeArchiveOpen(TCHAR *ArchiveName, const char *KeyString_, DARC_DECODEARCHIVE *Archive)
 {
 	u8 *HeadBuffer = NULL;
-	DARC_HEAD Head;
+	DARC_HEAD &Head = Archive->Head;
 	u8 *FileP, *NameP, *DirP;
 	FILE *ArcP = NULL;
-	TCHAR OldDir[MAX_PATH];
+	DARC_SOURCE &Src = Archive->Src;
+	DARC_CRYPTCONTEXT &CryptCtx = Archive->CryptCtx;
 	u8 Key[DXA_KEY_BYTES];
 	char KeyString[DXA_KEY_STRING_LENGTH + 1];
 	size_t KeyStringBytes;
 	char KeyStringBuffer[DXA_KEY_STRING_MAXLENGTH];
-	bool NoKey;
+	bool &NoKey = Archive->NoKey;
 
 	// 鍵文字列の保存と鍵の作成
 	{
@@ -2744,19 +3660,35 @@ int DXArchive::DecodeArchive(TCHAR *ArchiveName, const TCHAR *OutputPath, const
 	}
 
 	// アーカイブファイルを開く
-	ArcP = _tfopen(ArchiveName, TEXT("rb"));
+	// The data is extracted in storage order, so hint sequential access to the OS read-ahead ( FILE_FLAG_SEQUENTIAL_SCAN )
+	// Other processes can not write to the archive while it is open, a file truncated below the mapping would raise an access fault on a decode thread
+	bool DenyWrite = true;
+	ArcP           = _tfsopen(ArchiveName, TEXT("rbS"), _SH_DENYWR);
+	if (ArcP == NULL)
+	{
+		// The archive is open for writing somewhere else, it is only read without a mapping then, so a truncation fails the reads instead
+		DenyWrite = false;
+		ArcP      = _tfopen(ArchiveName, TEXT("rbS"));
+	}
 	if (ArcP == NULL) return -1;
 
-	// 出力先のディレクトリにカレントディレクトリを変更する
-	GetCurrentDirectory(MAX_PATH, OldDir);
-	SetCurrentDirectory(OutputPath);
+	memset(&Src, 0, sizeof(DARC_SOURCE));
+	Src.fp = ArcP;
+
+	// Read the header and the entries straight from the page cache when the archive can be mapped,
+	// otherwise the workers read the entries through a handle of their own that allows concurrent positioned reads
+	if (DenyWrite == false || SourceIsLocal(ArchiveName) == false || SourceMap(&Src) == false)
+	{
+		HANDLE ReadHandle = CreateFile(ArchiveName, GENERIC_READ, DenyWrite ? FILE_SHARE_READ : FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (ReadHandle != INVALID_HANDLE_VALUE) Src.ReadHandle = ReadHandle;
+	}
 
 	// ヘッダを解析する
 	{
 		s64 FileSize;
 
 		// ヘッダの読み込み
-		fread64(&Head, sizeof(DARC_HEAD), ArcP);
+		SourceRead(&Head, sizeof(DARC_HEAD), &Src);
 
 		// ＩＤの検査
 		if (Head.Head != DXA_HEAD)
@@ -2769,93 +3701,27 @@ int DXArchive::DecodeArchive(TCHAR *ArchiveName, const TCHAR *OutputPath, const
 
 		const uint16_t cryptVersion = Head.Flags >> 16;
 
-		g_cryptVersion = cryptVersion;
-		g_newCrypt     = (cryptVersion >= 331 && cryptVersion < 1000 || cryptVersion >= 1010);
-		g_chacha20     = cryptVersion == 0x64 || cryptVersion == 0xC8;
-
-		if (cryptVersion == 0xC8)
-		{
-			std::array<uint8_t, 4> data;
-			std::array<uint8_t, 64> key;
-
-			std::memcpy(data.data(), (uint8_t *)KeyString_ + KeyStringBytes + 1, 4);
-			wolf::crypt::chacha20::keySetup(data, key);
+		InitCryptContext(&CryptCtx, cryptVersion, KeyString_, KeyStringBytes);
 
-			std::memcpy(g_cc20Key, key.data(), 32);
-			std::memcpy(g_cc20Nonce, key.data() + 34, 12);
-		}
-
-		if (g_newCrypt)
+		if (CryptCtx.NewCrypt)
 		{
 			const uint8_t *pPwd = Head.Reserve;
-
-			memset(g_specialKey, 0, 768);
 			wolf::crypt::cryptAddresses((uint8_t *)&Head, pPwd, cryptVersion);
 
-			fseek(ArcP, 0, SEEK_END);
-			int32_t size = ftell(ArcP);
-			fseek(ArcP, 0, SEEK_SET);
-
-			uint8_t *pFileData = new uint8_t[size]();
-
-			size_t ret = fread(pFileData, 1, size, ArcP);
-
-			// Replace the beginning of the file data with the decrypted header
-			std::memcpy(pFileData, &Head, sizeof(DARC_HEAD));
-
-			uint8_t roundKey[wolf::crypt::aes::ROUND_KEY_SIZE] = { 0 };
-			wolf::crypt::initWolfCrypt(cryptVersion, pPwd, g_specialKey, nullptr, pFileData, 64, size - 64, true, KeyString_);
-
 			uint8_t *pK2 = nullptr;
 
 			if (cryptVersion >= 1010)
 				pK2 = (uint8_t *)KeyString_ + KeyStringBytes + 1;
 
-			wolf::crypt::aes::initAES128(roundKey, pPwd, pK2, cryptVersion);
-
-			if ((size - 64) < 0x400)
-				return 0;
-
-			uint32_t bodySize = 0x400;
-
-			if (wolf::crypt::utils::isV35(cryptVersion))
-			{
-				uint32_t seed = 0;
-
-				if (cryptVersion >= 1020)
-					seed = pK2[0] * pK2[1] + pPwd[2] * pPwd[4] + pPwd[11];
-				else
-					seed = pPwd[2] * pPwd[4] + pPwd[12]; // xorShift32 seed
-
-				if (!seed) seed = 1;
-				wolf::crypt::xorshift32(seed);
-
-				if (size >= static_cast<int32_t>(wolf::crypt::xorshift32() % 500 + 800))
-					wolf::crypt::xorshift32();
-
-				bodySize = size - 64; // 64 is the header size -- maybe replace with a constant
-
-				if (bodySize >= (wolf::crypt::xorshift32() % 500 + 800))
-					bodySize = (wolf::crypt::xorshift32() % 500) + 800;
-			}
-
-			wolf::crypt::aes::aesCtrXCrypt(pFileData + 64, roundKey, bodySize); // For v3.31 this has to be 0x400
-			wolf::crypt::aes::aesCtrXCrypt(pFileData + Head.FileNameTableStartAddress, roundKey, size - static_cast<int32_t>(Head.FileNameTableStartAddress));
+			// The archive stays on disk and the archive wide layers are removed from each read,
+			// so archives of any size work without a decrypted copy of the whole file in memory
+			const s64 ArchiveSize = SourceSize(&Src);
+			SourceSeek(&Src, sizeof(DARC_HEAD));
 
-			// Write to file
-			FILE *fp = fopen("decrypt_temp", "wb");
-			fwrite(pFileData, size, 1, fp);
-			fclose(fp);
-
-			delete[] pFileData;
-
-			// Close the current arc file and open the decrypted one
-			fclose(ArcP);
-
-			ArcP = fopen("decrypt_temp", "rb");
-			fseek(ArcP, sizeof(DARC_HEAD), SEEK_SET);
+			InitArchiveCrypt(&CryptCtx, &Head, pPwd, pK2, KeyString_, ArchiveSize);
+			Src.CryptCtx = &CryptCtx;
 
-			wolf::crypt::initWolfCrypt(cryptVersion, pPwd, g_specialKey, pK2);
+			wolf::crypt::initWolfCrypt(cryptVersion, pPwd, CryptCtx.SpecialKey, pK2);
 		}
 
 		// 鍵処理が行われていないかを取得する
@@ -2869,7 +3735,7 @@ int DXArchive::DecodeArchive(TCHAR *ArchiveName, const TCHAR *OutputPath, const
 		if ((Head.Flags & DXA_FLAG_NO_HEAD_PRESS) != 0)
 		{
 			// 圧縮されていない場合は普通に読み込む
-			KeyConvFileRead(HeadBuffer, Head.HeadSize, ArcP, NoKey ? NULL : Key, 0);
+			KeyConvSourceRead(HeadBuffer, Head.HeadSize, &Src, NoKey ? NULL : Key, 0, &CryptCtx);
 		}
 		else
 		{
@@ -2879,20 +3745,20 @@ int DXArchive::DecodeArchive(TCHAR *ArchiveName, const TCHAR *OutputPath, const
 			u64 LzHeadSize;
 
 			// ハフマン圧縮されたヘッダのサイズを取得する
-			_fseeki64(ArcP, 0, SEEK_END);
-			FileSize = _ftelli64(ArcP);
-			_fseeki64(ArcP, Head.FileNameTableStartAddress, SEEK_SET);
-			HuffHeadSize = (u32)(FileSize - _ftelli64(ArcP));
+			FileSize = SourceSize(&Src);
+			if (Head.FileNameTableStartAddress > (u64)FileSize) goto ERR;
+			SourceSeek(&Src, Head.FileNameTableStartAddress);
+			HuffHeadSize = (u64)(FileSize - SourceTell(&Src));
 
 			// ハフマン圧縮されたヘッダを読み込むメモリを確保する
 			HuffHeadBuffer = malloc((size_t)HuffHeadSize);
 			if (HuffHeadBuffer == NULL) goto ERR;
 
 			// ハフマン圧縮されたヘッダをコピーと暗号化解除
-			KeyConvFileRead(HuffHeadBuffer, HuffHeadSize, ArcP, NoKey ? NULL : Key, 0);
+			KeyConvSourceRead(HuffHeadBuffer, HuffHeadSize, &Src, NoKey ? NULL : Key, 0, &CryptCtx);
 
 			// ハフマン圧縮されたヘッダの解凍後の容量を取得する
-			LzHeadSize = Huffman_Decode(HuffHeadBuffer, NULL);
+			LzHeadSize = Huffman_DecodeChecked(HuffHeadBuffer, HuffHeadSize, NULL, HUFFMAN_UNCHECKED);
 
 			// ハフマン圧縮されたヘッダの解凍後のデータを格納するメモリ用域の確保
 			LzHeadBuffer = malloc((size_t)LzHeadSize);
@@ -2902,11 +3768,15 @@ int DXArchive::DecodeArchive(TCHAR *ArchiveName, const TCHAR *OutputPath, const
 				goto ERR;
 			}
 
-			// ハフマン圧縮されたヘッダを解凍する
-			Huffman_Decode(HuffHeadBuffer, LzHeadBuffer);
-
-			// LZ圧縮されたヘッダを解凍する
-			Decode(LzHeadBuffer, HeadBuffer);
+			// ハフマン圧縮されたヘッダと LZ 圧縮されたヘッダを解凍する
+			// A wrong key or a damaged archive yields garbage streams, the checked decoders reject them instead of overrunning the buffers
+			if (LzHeadSize == 0 || Huffman_DecodeChecked(HuffHeadBuffer, HuffHeadSize, LzHeadBuffer, LzHeadSize) != LzHeadSize ||
+				DecodeChecked(LzHeadBuffer, LzHeadSize, HeadBuffer, Head.HeadSize) != (s64)Head.HeadSize)
+			{
+				free(HuffHeadBuffer);
+				free(LzHeadBuffer);
+				goto ERR;
+			}
 
 			// メモリの解放
 			free(HuffHeadBuffer);
@@ -2919,38 +3789,56 @@ int DXArchive::DecodeArchive(TCHAR *ArchiveName, const TCHAR *OutputPath, const
 		DirP  = NameP + Head.DirectoryTableStartAddress;
 	}
 
-	// アーカイブの展開を開始する
-	DirectoryDecode(NameP, DirP, FileP, &Head, (DARC_DIRECTORY *)DirP, ArcP, Key, KeyString, KeyStringBytes, NoKey, KeyStringBuffer);
+	// Build the entry list, the header tables are not needed after this
+	if (BuildArchiveModel(NameP, DirP, FileP, &Head, KeyString, KeyStringBytes, NoKey, KeyStringBuffer, &Archive->Model) < 0) goto ERR;
 
-	// ファイルを閉じる
-	fclose(ArcP);
+	// Reject entries whose data lies outside of the archive, their sizes also decide the size of the work memory
+	{
+		const u64 ArchiveSize = (u64)SourceSize(&Src);
+		const u64 HuffSplit   = Head.HuffmanEncodeKB != 0xff ? Head.HuffmanEncodeKB * 1024 * 2 : 0;
 
-	// ヘッダを読み込んでいたメモリを解放する
-	free(HeadBuffer);
+		for (const DARC_ENTRY &Entry : Archive->Model.Entries)
+		{
+			if (Entry.Directory) continue;
 
-	if (g_newCrypt)
-	{
-		// Remove the decrypted file
-		remove("decrypt_temp");
+			// Bound each size first so the sums below can not overflow, Huffman codes are at least one bit long and the LZ data stores the size in 32 bits
+			if (Entry.HuffPressDataSize != 0xffffffffffffffff && Entry.HuffPressDataSize > ArchiveSize) goto ERR;
+			if (Entry.PressDataSize != 0xffffffffffffffff && (Entry.PressDataSize > ArchiveSize * 8 + HuffSplit || Entry.DataSize > 0xffffffff)) goto ERR;
+			if (Entry.PressDataSize == 0xffffffffffffffff && Entry.DataSize > ArchiveSize * 8 + HuffSplit) goto ERR;
+
+			if (Entry.DataPosition > ArchiveSize || GetStoredSize(&Head, &Entry) > ArchiveSize - Entry.DataPosition) goto ERR;
+		}
 	}
 
-	// カレントディレクトリを元に戻す
-	SetCurrentDirectory(OldDir);
+	// ヘッダを読み込んでいたメモリを解放する
+	free(HeadBuffer);
 
 	// 終了
 	return 0;
 
 ERR:
 	if (HeadBuffer != NULL) free(HeadBuffer);
-	if (ArcP != NULL) fclose(ArcP);
-
-	// カレントディレクトリを元に戻す
-	SetCurrentDirectory(OldDir);
+	DecodeArchiveClose(Archive);
 
 	// 終了
 	return -1;
 }
 
+// Close an archive opened with DecodeArchiveOpen
+void DXArchive::DecodeArchiveClose(DARC_DECODEARCHIVE *Archive)
+{
+	// ファイルを閉じる
+	SourceUnmap(&Archive->Src);
+
+	if (Archive->Src.ReadHandle != NULL) CloseHandle((HANDLE)Archive->Src.ReadHandle);
+	if (Archive->Src.fp != NULL) fclose(Archive->Src.fp);
+
+	Archive->Src.fp         = NULL;
+	Archive->Src.ReadHandle = NULL;
+	Archive->Src.CryptCtx   = NULL;
+}
+
+
 // コンストラクタ
 DXArchive::DXArchive(TCHAR *ArchivePath)
 {
@@ -3126,7 +4014,7 @@ int DXArchive::OpenArchiveFile(const TCHAR *ArchivePath, const char *KeyString_)
 			_fseeki64(this->fp, 0, SEEK_END);
 			FileSize = _ftelli64(this->fp);
 			_fseeki64(this->fp, this->Head.FileNameTableStartAddress, SEEK_SET);
-			HuffHeadSize = (u32)(FileSize - _ftelli64(this->fp));
+			HuffHeadSize = (u64)(FileSize - _ftelli64(this->fp));
 
 			// ハフマン圧縮されたヘッダを読み込むメモリを確保する
 			HuffHeadBuffer = malloc((size_t)HuffHeadSize);
@@ -4165,7 +5053,7 @@ s64 DXArchiveFile::Read(void *Buffer, s64 ReadLength)
 
 	// アーカイブファイルポインタと、仮想ファイルポインタが一致しているか調べる
 	// 一致していなかったらアーカイブファイルポインタを移動する
-	if (this->DataBuffer == NULL && _ftelli64(this->Archive->GetFilePointer()) != (s32)(this->FileData->DataAddress + this->Archive->GetHeader()->DataStartAddress + this->FilePoint))
+	if (this->DataBuffer == NULL && _ftelli64(this->Archive->GetFilePointer()) != (s64)(this->FileData->DataAddress + this->Archive->GetHeader()->DataStartAddress + this->FilePoint))
 	{
 		_fseeki64(this->Archive->GetFilePointer(), this->FileData->DataAddress + this->Archive->GetHeader()->DataStartAddress + this->FilePoint, SEEK_SET);
 	}
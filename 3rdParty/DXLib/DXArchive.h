@@ -74,9 +74,11 @@
 #define DXA_VER							(0x0008)		// バージョン
 #define DXA_VER_MIN						(0x0008)		// 対応している最低バージョン
 #define DXA_BUFFERSIZE					(0x1000000)		// アーカイブ作成時に使用するバッファのサイズ
+#define DXA_READAHEADSIZE				(0x400000)		// Maximum size of a read covering the data of several files when extracting
 #define DXA_KEY_BYTES					(7)				// 鍵のバイト数
 #define DXA_KEY_STRING_LENGTH			(63)			// 鍵用文字列の長さ
 #define DXA_KEY_STRING_MAXLENGTH		(2048)			// 鍵用文字列バッファのサイズ
+#define DXA_MAXDIRECTORYDEPTH			(256)			// Deepest directory nesting accepted when extracting
 
 // フラグ
 #define DXA_FLAG_NO_KEY					(0x00000001)	// 鍵処理無し
@@ -177,8 +179,133 @@ typedef struct tagDARC_ENCODEINFO
 	bool OutputStatus ;				// 状況出力を行うかどうか
 } DARC_ENCODEINFO ;
 
+// Per archive crypt state for the Wolf RPG specific encryptions, passed to KeyConv instead of using process wide state
+typedef struct tagDARC_CRYPTCONTEXT
+{
+	uint16_t CryptVersion ;			// Crypt version stored in the upper 16 bit of DARC_HEAD::Flags
+	bool NewCrypt ;					// v3.31+ / Pro crypt
+	bool ChaCha20 ;					// ChaCha2 crypt
+	u8 SpecialKey[ 768 ] ;			// Key used for the new crypt
+	u8 CC20Key[ 32 ] ;				// ChaCha20 key
+	u8 CC20Nonce[ 12 ] ;			// ChaCha20 nonce
+
+	// Layers the v3.31+ crypt puts over the whole archive, removed by SourceRead / SourceReadAt while reading
+	bool ArchiveCrypt ;				// The archive wide layers are present
+	u8 ArchiveKey[ 768 ] ;			// Key of the archive wide wolfCrypt layer
+	u64 ArchiveKeyStart ;			// Archive position the wolfCrypt layer starts at
+	u64 ArchiveKeyEnd ;				// Archive position the wolfCrypt layer ends at
+	bool ArchiveAes ;				// The AES-CTR layer is present
+	u8 AesRoundKey[ 192 ] ;			// AES round key followed by the IV ( wolf::crypt::aes::ROUND_KEY_SIZE )
+	u64 AesBodyStart ;				// AES encrypted part at the beginning of the data
+	u64 AesBodyEnd ;
+	u64 AesTailStart ;				// AES encrypted compressed header at the end of the archive
+	u64 AesTailEnd ;
+	u64 AesTailCounter ;			// Key stream offset the compressed header is encrypted with
+} DARC_CRYPTCONTEXT ;
+
+// Source the archive data is read from while decoding, either the archive file itself or an in-memory window of it
+typedef struct tagDARC_SOURCE
+{
+	FILE *fp ;						// Archive file
+	u8 *Image ;						// Mapped archive file or an already decrypted window of it, NULL when reading from the file
+	u64 ImageSize ;					// Size of the memory image
+	u64 Position ;					// Read position inside the memory image
+	u64 ImageBase ;					// Archive position of the first byte of the memory image, only used by SourceReadAt
+	const DARC_CRYPTCONTEXT *CryptCtx ;	// Archive wide crypt layers removed from the data read from the archive file ( NULL:none )
+	void *Mapping ;					// File mapping object when Image is a view of the whole archive file ( NULL:not mapped )
+	void *ReadHandle ;				// Archive file opened for overlapped reads by SourceReadAt ( NULL:read through fp )
+} DARC_SOURCE ;
+
+// DARC_ENTRY::ParentIndex of entries in the archive root
+#define DARC_ENTRY_ROOT				((size_t)-1)
+
+// Entry of the decoded archive directory, built once from the name, file and directory tables
+typedef struct tagDARC_ENTRY
+{
+	size_t PathOffset ;				// Offset of the path inside the archive in DARC_ARCHIVEMODEL::NameArena
+	size_t ParentIndex ;			// Index of the directory entry containing this entry ( DARC_ENTRY_ROOT:archive root )
+	u64 Attributes ;				// ファイル属性
+	DARC_FILETIME Time ;			// 時間情報
+	u64 DataPosition ;				// Position of the data in the archive file ( DataStartAddress already added )
+	u64 DataSize ;					// ファイルのデータサイズ
+	u64 PressDataSize ;				// 圧縮後のデータのサイズ( 0xffffffffffffffff:圧縮されていない )
+	u64 HuffPressDataSize ;			// ハフマン圧縮後のデータのサイズ( 0xffffffffffffffff:圧縮されていない )
+	bool Directory ;				// Entry is a directory
+	bool AntiUnpack ;				// File can start with the anti-unpack banner
+	u8 Key[ DXA_KEY_BYTES ] ;		// Per file key
+} DARC_ENTRY ;
+
+// Flat list of all entries of an archive, directories come before their content
+typedef struct tagDARC_ARCHIVEMODEL
+{
+	std::vector<DARC_ENTRY> Entries ;	// All files and directories
+	std::vector<TCHAR> NameArena ;		// Null terminated '\\' separated paths of all entries
+} DARC_ARCHIVEMODEL ;
+
+// Archive opened for extraction, everything needed to decode the entries without the raw header tables
+typedef struct tagDARC_DECODEARCHIVE
+{
+	DARC_HEAD Head ;				// Decrypted archive header
+	DARC_SOURCE Src ;				// Source the entry data is read from
+	DARC_CRYPTCONTEXT CryptCtx ;	// Crypt state of the archive
+	bool NoKey ;					// Archive is not encrypted with the key
+	DARC_ARCHIVEMODEL Model ;		// Entries of the archive
+} DARC_DECODEARCHIVE ;
+
+// Files with neighbouring data that are extracted together, their stored data is read with a single read
+typedef struct tagDARC_DECODEBATCH
+{
+	size_t Begin ;					// First file of the batch
+	size_t End ;					// One past the last file of the batch
+	u64 ReadPosition ;				// Archive position of the data of the first file
+	u64 ReadSize ;					// Size of the read covering all files ( 0:read each file on its own )
+} DARC_DECODEBATCH ;
+
+// Part of the compressed data of a file read by the streaming decoder
+typedef struct tagDARC_STREAMSEGMENT
+{
+	const u8 *Data ;				// Data in memory, NULL to read it from the archive
+	u64 Position ;					// Archive position of the data
+	u64 KeyPosition ;				// Key position of the data
+	u64 Size ;						// Size of the data
+} DARC_STREAMSEGMENT ;
+
+// Compressed data of a file read in pieces by the streaming decoder
+typedef struct tagDARC_STREAMINPUT
+{
+	DARC_STREAMSEGMENT Segment[ 3 ] ;	// Huffman decoded beginning, stored middle and Huffman decoded end, or the LZ data only
+	int SegmentNum ;				// Number of segments
+	int SegmentIndex ;				// Segment the next bytes are read from
+	u64 SegmentRead ;				// Bytes already read from that segment
+	u8 *Buffer ;					// Read buffer
+	u64 BufferSize ;				// Size of the read buffer
+	u64 Pos ;						// Next unconsumed byte in the buffer
+	u64 End ;						// End of the buffered data
+	DARC_SOURCE *Src ;				// Archive source
+	unsigned char *Key ;			// Per file key
+	const DARC_CRYPTCONTEXT *CryptCtx ;	// Crypt state of the archive
+	bool ReadError ;				// Data could not be read from the archive, the stream ended early
+} DARC_STREAMINPUT ;
+
+// Settings of a single extraction, passed to each call so concurrent extractions do not affect each other
+typedef struct tagDARC_DECODEOPTIONS
+{
+	int ThreadNum ;							// Number of threads extracting the files ( 0: one per hardware thread )
+	std::vector<std::wstring> Include ;		// Glob patterns of the entries to extract ( empty:all )
+	std::vector<std::wstring> Exclude ;		// Glob patterns of the entries to skip
+} DARC_DECODEOPTIONS ;
+
+// Work memory of a decode worker, reused for all files the worker extracts
+typedef struct tagDARC_DECODEBUFFER
+{
+	void *Data ;					// Buffer
+	u64 Size ;						// Size of the buffer
+} DARC_DECODEBUFFER ;
+
 // class ----------------------------------------
 
+class DXArchiveSink ;
+
 // アーカイブクラス
 class DXArchive
 {
@@ -198,6 +325,10 @@ public :
 	static int 			EncodeArchiveOneDirectory(const TCHAR *OutputFileName, const TCHAR *FolderPath, bool Press = false, bool AlwaysHuffman = false, u8 HuffmanEncodeKB = 0, const char *KeyString_ = NULL, bool NoKey = false, bool OutputStatus = true, bool MaxPress = false, uint16_t cryptVersion = 0);                               // アーカイブファイルを作成する(ディレクトリ一個だけ)
 	static int			EncodeArchiveOneDirectoryWolf(const TCHAR *OutputFileName, const TCHAR *DirectoryPath, bool Press = false, const char *KeyString_ = NULL, uint16_t cryptVersion = 0);
 	static int			DecodeArchive(TCHAR *ArchiveName, const TCHAR *OutputPath, const char *KeyString_ = NULL ) ;								// アーカイブファイルを展開する
+	static int			DecodeArchiveToSink( TCHAR *ArchiveName, DXArchiveSink *Sink, const char *KeyString_ = NULL, const DARC_DECODEOPTIONS *Options = NULL ) ;	// Extract an archive into the given sink ( Options NULL:all entries, one thread per hardware thread )
+	static int			ListArchive( TCHAR *ArchiveName, DARC_ARCHIVEMODEL *Model, const char *KeyString_ = NULL ) ;										// Read the entry list of an archive, only the header is decoded ( 0:success  -1:failure )
+	static int			ProbeArchive( TCHAR *ArchiveName, const char *KeyString_ = NULL ) ;																// Check if the key fits by only decoding and validating the header ( 0:fits  -1:does not fit )
+	static inline const TCHAR *GetEntryPath( const DARC_ARCHIVEMODEL *Model, const DARC_ENTRY *Entry ) { return &Model->NameArena[ Entry->PathOffset ] ; }	// Get the path of an entry inside the archive
 
 	int					OpenArchiveFile( const TCHAR *ArchivePath, const char *KeyString_ = NULL ) ;				// アーカイブファイルを開く( 0:成功  -1:失敗 )
 	int					OpenArchiveFileMem( const TCHAR *ArchivePath, const char *KeyString_ = NULL ) ;			// アーカイブファイルを開き最初にすべてメモリ上に読み込んでから処理する( 0:成功  -1:失敗 )
@@ -226,12 +357,28 @@ public :
 	static void NotConvFileRead( void *Data, s64 Size, FILE *fp ) ;												// データを反転させてファイルから読み込む関数
 	static size_t CreateKeyFileString( int CharCodeFormat, const char *KeyString, size_t KeyStringBytes, DARC_DIRECTORY *Directory, DARC_FILEHEAD *FileHead, u8 *FileTable, u8 *DirectoryTable, u8 *NameTable, u8 *FileString ) ;	// カレントディレクトリにある指定のファイルの鍵用の文字列を作成する、戻り値は文字列の長さ( 単位：Byte )( FileString は DXA_KEY_STRING_MAXLENGTH の長さが必要 )
 	static void KeyCreate( const char *Source, size_t SourceBytes, u8 *Key ) ;									// 鍵文字列を作成
-	static void KeyConv( void *Data, s64 Size, s64 Position, unsigned char *Key ) ;								// 鍵文字列を使用して Xor 演算( Key は必ず DXA_KEY_BYTES の長さがなければならない )
-	static void KeyConvFileWrite( void *Data, s64 Size, FILE *fp, unsigned char *Key, s64 Position = -1 ) ;		// データを鍵文字列を使用して Xor 演算した後ファイルに書き出す関数( Key は必ず DXA_KEY_BYTES の長さがなければならない )
-	static void KeyConvFileRead( void *Data, s64 Size, FILE *fp, unsigned char *Key, s64 Position = -1 ) ;		// ファイルから読み込んだデータを鍵文字列を使用して Xor 演算する関数( Key は必ず DXA_KEY_BYTES の長さがなければならない )
+	static void InitCryptContext( DARC_CRYPTCONTEXT *CryptCtx, uint16_t CryptVersion, const char *KeyString, size_t KeyStringBytes ) ;	// Set up the crypt context for the given crypt version
+	static void InitArchiveCrypt( DARC_CRYPTCONTEXT *CryptCtx, const DARC_HEAD *Head, const u8 *Pwd, u8 *ProKey, const char *KeyString, s64 ArchiveSize ) ;	// Set up the archive wide crypt layers of the v3.31+ crypt
+	static void SourceDecrypt( const DARC_SOURCE *Src, void *Data, s64 Size, s64 Position ) ;					// Remove the archive wide crypt layers from data read from the archive file
+	static void KeyConv( void *Data, s64 Size, s64 Position, unsigned char *Key, const DARC_CRYPTCONTEXT *CryptCtx = NULL ) ;								// 鍵文字列を使用して Xor 演算( Key は必ず DXA_KEY_BYTES の長さがなければならない )
+	static void KeyConvFileWrite( void *Data, s64 Size, FILE *fp, unsigned char *Key, s64 Position = -1, const DARC_CRYPTCONTEXT *CryptCtx = NULL ) ;		// データを鍵文字列を使用して Xor 演算した後ファイルに書き出す関数( Key は必ず DXA_KEY_BYTES の長さがなければならない )
+	static void KeyConvFileRead( void *Data, s64 Size, FILE *fp, unsigned char *Key, s64 Position = -1, const DARC_CRYPTCONTEXT *CryptCtx = NULL ) ;		// ファイルから読み込んだデータを鍵文字列を使用して Xor 演算する関数( Key は必ず DXA_KEY_BYTES の長さがなければならない )
+	static s64 SourceTell( DARC_SOURCE *Src ) ;																	// Get the current read position of the archive source
+	static void SourceSeek( DARC_SOURCE *Src, s64 Position ) ;													// Set the read position of the archive source
+	static s64 SourceSize( DARC_SOURCE *Src ) ;																	// Get the total size of the archive source
+	static void SourceRead( void *Buffer, s64 Size, DARC_SOURCE *Src ) ;										// Read data from the archive source
+	static void KeyConvSourceRead( void *Data, s64 Size, DARC_SOURCE *Src, unsigned char *Key, s64 Position = -1, const DARC_CRYPTCONTEXT *CryptCtx = NULL ) ;	// Same as KeyConvFileRead but reads from the archive source
+	static s64 SourceReadAt( void *Buffer, s64 Size, s64 Position, DARC_SOURCE *Src ) ;						// Read data from the given position of the archive source without moving the read position, returns the number of bytes read
+	static int KeyConvSourceReadAt( void *Data, s64 Size, s64 ReadPosition, DARC_SOURCE *Src, unsigned char *Key, s64 Position = -1, const DARC_CRYPTCONTEXT *CryptCtx = NULL ) ;	// Same as KeyConvSourceRead but reads from the given position ( 0:success  -1:short read )
+	static bool SourceMap( DARC_SOURCE *Src ) ;																	// Map the archive file into memory and read from the mapping from now on ( true:mapped )
+	static bool SourceIsLocal( const TCHAR *ArchiveName ) ;															// Check if the archive is on a local fixed drive, only those are mapped
+	static void SourceUnmap( DARC_SOURCE *Src ) ;																// Release the mapping of the archive file
+	static const u8 *SourceView( const DARC_SOURCE *Src, s64 Position, s64 Size ) ;							// Get data of a mapped archive that can be used without reading it ( NULL:the data has to be read )
+	static const u8 *KeyConvSourceFetch( void *Buffer, s64 Size, s64 ReadPosition, DARC_SOURCE *Src, unsigned char *Key, s64 Position = -1, const DARC_CRYPTCONTEXT *CryptCtx = NULL ) ;	// Same as KeyConvSourceReadAt but returns the data inside the mapping instead of copying it when possible ( NULL:short read )
 	static DATE_RESULT DateCmp( DARC_FILETIME *date1, DARC_FILETIME *date2 ) ;									// どちらが新しいかを比較する
 	static int Encode( void *Src, u32 SrcSize, void *Dest, bool OutStatus = true, bool MaxPress = false ) ;		// データを圧縮する( 戻り値:圧縮後のデータサイズ )
 	static int Decode( void *Src, void *Dest ) ;																// データを解凍する( 戻り値:解凍後のデータサイズ )
+	static s64 DecodeChecked( const void *Src, u64 SrcSize, void *Dest, u64 DestSize ) ;						// Decode that never reads or writes outside the given buffer sizes ( -1:damaged data )
 	static u32 HashCRC32( const void *SrcData, size_t SrcDataSize ) ;											// バイナリデータを元に CRC32 のハッシュ値を計算する
 
 	DARC_DIRECTORY *GetCurrentDirectoryInfo( void ) ;															// アーカイブ内のカレントディレクトリの情報を取得する
@@ -282,8 +429,27 @@ protected :
 		u16 PackNum ;
 	} SEARCHDATA ;
 
-	static int DirectoryEncode( int CharCodeFormat, TCHAR *DirectoryName, u8 *NameP, u8 *DirP, u8 *FileP, DARC_DIRECTORY *ParentDir, SIZESAVE *Size, int DataNumber, FILE *DestFp, void *TempBuffer, bool Press, bool MaxPress, bool AlwaysHuffman, u8 HuffmanEncodeKB, const char *KeyString, size_t KeyStringBytes, bool NoKey, char *KeyStringBuffer, DARC_ENCODEINFO *EncodeInfo ) ;	// 指定のディレクトリにあるファイルをアーカイブデータに吐き出す
-	static int DirectoryDecode( u8 *NameP, u8 *DirP, u8 *FileP, DARC_HEAD *Head, DARC_DIRECTORY *Dir, FILE *ArcP, unsigned char *Key, const char *KeyString, size_t KeyStringBytes, bool NoKey, char *KeyStringBuffer ) ;											// 指定のディレクトリデータにあるファイルを展開する
+	static int DirectoryEncode( int CharCodeFormat, TCHAR *DirectoryName, u8 *NameP, u8 *DirP, u8 *FileP, DARC_DIRECTORY *ParentDir, SIZESAVE *Size, int DataNumber, FILE *DestFp, void *TempBuffer, bool Press, bool MaxPress, bool AlwaysHuffman, u8 HuffmanEncodeKB, const char *KeyString, size_t KeyStringBytes, bool NoKey, char *KeyStringBuffer, DARC_ENCODEINFO *EncodeInfo, const DARC_CRYPTCONTEXT *CryptCtx ) ;	// 指定のディレクトリにあるファイルをアーカイブデータに吐き出す
+	static int DecodeArchiveOpen( TCHAR *ArchiveName, const char *KeyString_, DARC_DECODEARCHIVE *Archive ) ;	// Open an archive for extraction, reads and decodes the header and builds the entry model
+	static void DecodeArchiveClose( DARC_DECODEARCHIVE *Archive ) ;		// Close an archive opened with DecodeArchiveOpen
+	static int BuildArchiveModel( u8 *NameP, u8 *DirP, u8 *FileP, DARC_HEAD *Head, const char *KeyString, size_t KeyStringBytes, bool NoKey, char *KeyStringBuffer, DARC_ARCHIVEMODEL *Model ) ;	// Build the decoded entry list of an archive from the raw header tables
+	static int DirectoryBuildModel( u8 *NameP, u8 *DirP, u8 *FileP, DARC_HEAD *Head, DARC_DIRECTORY *Dir, const std::wstring &DirPath, size_t DirIndex, const char *KeyString, size_t KeyStringBytes, bool NoKey, char *KeyStringBuffer, DARC_ARCHIVEMODEL *Model ) ;	// Add the entries of the given directory data to the model
+	static int DirectoryDecode( DARC_HEAD *Head, const DARC_ARCHIVEMODEL *Model, DXArchiveSink *Sink, DARC_SOURCE *ArcP, bool NoKey, const DARC_CRYPTCONTEXT *CryptCtx, const DARC_DECODEOPTIONS *Options ) ;	// 指定のディレクトリデータにあるファイルを展開する
+	static int FileDecode( const DARC_ARCHIVEMODEL *Model, const DARC_ENTRY *File, DARC_HEAD *Head, DARC_SOURCE *ArcP, DXArchiveSink *Sink, bool NoKey, const DARC_CRYPTCONTEXT *CryptCtx, DARC_DECODEBUFFER *Buffer ) ;	// Extract a single file of the archive
+	static void CreateDecodeBatches( DARC_HEAD *Head, const std::vector<const DARC_ENTRY *> &Files, bool ReadAhead, std::vector<DARC_DECODEBATCH> *Batches ) ;	// Group files sorted by data position into batches read with a single read
+	static u64 GetStoredSize( DARC_HEAD *Head, const DARC_ENTRY *Entry ) ;	// Get the number of bytes FileDecode reads from the archive for a file
+	static u64 GetDecodeWorkSize( DARC_HEAD *Head, const DARC_ENTRY *Entry ) ;			// Get the size of the work memory needed to extract a file
+	static bool IsStreamDecode( DARC_HEAD *Head, const DARC_ENTRY *Entry ) ;	// Check if a file is extracted with the streaming decoder
+	static int FileDecodeStream( const DARC_ENTRY *File, DARC_HEAD *Head, DARC_SOURCE *ArcP, DXArchiveSink *Sink, void *DestP, unsigned char *Key, const DARC_CRYPTCONTEXT *CryptCtx, u8 *Work ) ;	// Extract a large compressed file with a bounded amount of memory
+	static void AddStreamSegment( DARC_STREAMINPUT *In, const u8 *Data, u64 Position, u64 KeyPosition, u64 Size ) ;	// Add a part of the compressed data to a stream
+	static u64 StreamFill( DARC_STREAMINPUT *In ) ;						// Refill the read buffer of a stream, returns the number of buffered bytes
+	static int DecodeStream( DARC_STREAMINPUT *In, DXArchiveSink *Sink, void *Handle, const DARC_ENTRY *Entry, u8 *Window ) ;	// Streaming version of Decode
+	static void *ReserveDecodeBuffer( DARC_DECODEBUFFER *Buffer, u64 Size ) ;	// Make sure the work buffer can hold Size bytes ( NULL:out of memory )
+	static int SinkWrite( DXArchiveSink *Sink, void *Handle, const DARC_ENTRY *Entry, void *Data, u64 Size, bool FileBegin ) ;	// Write decoded data to the sink, drops the anti-unpack banner
+	static bool IsAntiUnpackFile( const TCHAR *FileName ) ;				// Check if a file can carry the anti-unpack banner
+	static bool IsEntrySelected( const DARC_DECODEOPTIONS *Options, const TCHAR *Path ) ;	// Check if an entry passes the include and exclude filters
+	static bool MatchEntryPattern( const std::wstring &Pattern, const TCHAR *Path ) ;	// Check if an entry or one of its parent directories matches a pattern
+	static bool MatchPattern( const TCHAR *Pattern, const TCHAR *Path, const TCHAR *PathEnd ) ;	// Match a path against a glob pattern
 	static int StrICmp( const TCHAR *Str1, const TCHAR *Str2 ) ;							// 比較対照の文字列中の大文字を小文字として扱い比較する( 0:等しい  1:違う )
 	static int ConvSearchData( SEARCHDATA *Dest, const TCHAR *Src, int *Length ) ;		// 文字列を検索用のデータに変換( ヌル文字か \ があったら終了 )
 	static int AddFileNameData( const TCHAR *FileName, u8 *FileNameTable ) ;				// ファイル名データを追加する( 戻り値は使用したデータバイト数 )
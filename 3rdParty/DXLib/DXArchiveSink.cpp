@@ -0,0 +1,215 @@
+// -------------------------------------------------------------------------------
+//
+//		Output sinks for the DX archive decoder
+//
+// -------------------------------------------------------------------------------
+
+// include ----------------------------
+#include "DXArchiveSink.h"
+#include <stdio.h>
+#include <string.h>
+#include <new>
+#include <windows.h>
+
+// define -----------------------------
+
+// Largest size the memory sink reserves up front, the size comes from the archive so a damaged header must not allocate more
+#define DARC_MEMSINK_MAXRESERVE		(64 * 1024 * 1024)
+
+// data type --------------------------
+
+// Open file of the file system sink
+typedef struct tagDARC_FSSINKFILE
+{
+	FILE *fp ;						// Output file
+	std::wstring FullPath ;			// Full path of the output file
+} DARC_FSSINKFILE ;
+
+// Open file of the memory sink
+typedef struct tagDARC_MEMSINKFILE
+{
+	std::wstring Path ;				// Path inside the archive
+	std::vector<u8> Data ;			// File data
+} DARC_MEMSINKFILE ;
+
+// class code -------------------------
+
+DXArchiveFileSystemSink::DXArchiveFileSystemSink(const TCHAR *OutputPath)
+{
+	this->OutputPath = OutputPath != NULL ? OutputPath : TEXT("");
+}
+
+// Append a name to a path, used for the paths inside the archive and to put them below the output directory
+// An empty Dir is the archive root or the current directory, a trailing separator is not doubled
+std::wstring DXArchiveSink::JoinPath(const std::wstring &Dir, const TCHAR *Name)
+{
+	if (Dir.empty()) return std::wstring(Name);
+
+	if (Dir.back() == TEXT('\\') || Dir.back() == TEXT('/'))
+		return Dir + Name;
+
+	return Dir + TEXT("\\") + Name;
+}
+
+int DXArchiveFileSystemSink::MakeDirectory(const TCHAR *Path)
+{
+	const std::wstring FullPath = JoinPath(OutputPath, Path);
+
+	if (CreateDirectory(FullPath.c_str(), NULL) == FALSE && GetLastError() != ERROR_ALREADY_EXISTS)
+		return -1;
+
+	return 0;
+}
+
+void *DXArchiveFileSystemSink::BeginFile(const TCHAR *Path, u64 Size)
+{
+	DARC_FSSINKFILE *File = new DARC_FSSINKFILE;
+
+	File->FullPath = JoinPath(OutputPath, Path);
+	File->fp       = _tfopen(File->FullPath.c_str(), TEXT("wb"));
+
+	if (File->fp == NULL)
+	{
+		delete File;
+		return NULL;
+	}
+
+	return File;
+}
+
+int DXArchiveFileSystemSink::Write(void *Handle, const void *Data, u64 Size)
+{
+	DARC_FSSINKFILE *File = (DARC_FSSINKFILE *)Handle;
+
+	DXArchive::fwrite64((void *)Data, Size, File->fp);
+
+	return ferror(File->fp) ? -1 : 0;
+}
+
+int DXArchiveFileSystemSink::EndFile(void *Handle, const DARC_ENTRY *Entry)
+{
+	DARC_FSSINKFILE *File = (DARC_FSSINKFILE *)Handle;
+	const std::wstring FullPath = File->FullPath;
+
+	// ファイルを閉じる
+	const int CloseResult = fclose(File->fp);
+	delete File;
+
+	// Writing the last buffered bytes can still fail here, e.g., on a full disk
+	if (CloseResult != 0) return -1;
+
+	// ファイルのタイムスタンプを設定する
+	{
+		HANDLE HFile;
+		FILETIME CreateTime, LastAccessTime, LastWriteTime;
+		HFile = CreateFile(FullPath.c_str(),
+						   GENERIC_WRITE, 0, NULL,
+						   OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+		if (HFile != INVALID_HANDLE_VALUE)
+		{
+			CreateTime.dwHighDateTime     = (u32)(Entry->Time.Create >> 32);
+			CreateTime.dwLowDateTime      = (u32)(Entry->Time.Create & 0xffffffffffffffff);
+			LastAccessTime.dwHighDateTime = (u32)(Entry->Time.LastAccess >> 32);
+			LastAccessTime.dwLowDateTime  = (u32)(Entry->Time.LastAccess & 0xffffffffffffffff);
+			LastWriteTime.dwHighDateTime  = (u32)(Entry->Time.LastWrite >> 32);
+			LastWriteTime.dwLowDateTime   = (u32)(Entry->Time.LastWrite & 0xffffffffffffffff);
+			SetFileTime(HFile, &CreateTime, &LastAccessTime, &LastWriteTime);
+			CloseHandle(HFile);
+		}
+	}
+
+	// ファイル属性を付ける
+	SetFileAttributes(FullPath.c_str(), (u32)Entry->Attributes & ~(FILE_ATTRIBUTE_SYSTEM | FILE_ATTRIBUTE_HIDDEN));
+
+	return 0;
+}
+
+int DXArchiveMemorySink::MakeDirectory(const TCHAR *Path)
+{
+	return 0;
+}
+
+void *DXArchiveMemorySink::BeginFile(const TCHAR *Path, u64 Size)
+{
+	DARC_MEMSINKFILE *File = new DARC_MEMSINKFILE;
+
+	File->Path = Path;
+
+	// Larger files grow in Write instead
+	try
+	{
+		File->Data.reserve((size_t)(Size > DARC_MEMSINK_MAXRESERVE ? DARC_MEMSINK_MAXRESERVE : Size));
+	}
+	catch (const std::bad_alloc &)
+	{
+		delete File;
+		return NULL;
+	}
+
+	return File;
+}
+
+int DXArchiveMemorySink::Write(void *Handle, const void *Data, u64 Size)
+{
+	DARC_MEMSINKFILE *File = (DARC_MEMSINKFILE *)Handle;
+
+	// Runs on a decode thread, an exception would end the whole process
+	try
+	{
+		File->Data.insert(File->Data.end(), (const u8 *)Data, (const u8 *)Data + Size);
+	}
+	catch (const std::bad_alloc &)
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+int DXArchiveMemorySink::EndFile(void *Handle, const DARC_ENTRY *Entry)
+{
+	DARC_MEMSINKFILE *File = (DARC_MEMSINKFILE *)Handle;
+
+	{
+		std::lock_guard<std::mutex> Lock(Mutex);
+		Files[File->Path] = std::move(File->Data);
+	}
+
+	delete File;
+
+	return 0;
+}
+
+// Get the data of an extracted file ( NULL:not found )
+const std::vector<u8> *DXArchiveMemorySink::GetFile(const std::wstring &Path) const
+{
+	auto It = Files.find(Path);
+
+	return It != Files.end() ? &It->second : NULL;
+}
+
+int DXArchiveNullSink::MakeDirectory(const TCHAR *Path)
+{
+	return 0;
+}
+
+void *DXArchiveNullSink::BeginFile(const TCHAR *Path, u64 Size)
+{
+	// Any non NULL handle will do
+	return this;
+}
+
+int DXArchiveNullSink::Write(void *Handle, const void *Data, u64 Size)
+{
+	ByteNum += Size;
+
+	return 0;
+}
+
+int DXArchiveNullSink::EndFile(void *Handle, const DARC_ENTRY *Entry)
+{
+	FileNum++;
+
+	return 0;
+}
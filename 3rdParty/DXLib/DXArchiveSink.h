@@ -0,0 +1,85 @@
+// -------------------------------------------------------------------------------
+//
+//		Output sinks for the DX archive decoder
+//
+// -------------------------------------------------------------------------------
+
+#ifndef DX_ARCHIVE_SINK_H
+#define DX_ARCHIVE_SINK_H
+
+// include --------------------------------------
+#include "DXArchive.h"
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// class ----------------------------------------
+
+// Destination of the files extracted by DXArchive::DecodeArchiveToSink
+// Paths are relative to the archive root, the files of an archive are extracted in parallel so all functions have to be thread safe
+class DXArchiveSink
+{
+public :
+	virtual ~DXArchiveSink() {}
+
+	virtual int			MakeDirectory( const TCHAR *Path ) = 0 ;								// Create a directory ( 0:success  -1:failure )
+	virtual void		*BeginFile( const TCHAR *Path, u64 Size ) = 0 ;						// Start writing a file, the returned handle is passed to Write and EndFile ( NULL:failure )
+	virtual int			Write( void *Handle, const void *Data, u64 Size ) = 0 ;						// Append data to the file ( 0:success  -1:failure )
+	virtual int			EndFile( void *Handle, const DARC_ENTRY *Entry ) = 0 ;				// Finish the file, Entry holds the time stamps and attributes ( 0:success  -1:failure )
+
+	static std::wstring	JoinPath( const std::wstring &Dir, const TCHAR *Name ) ;					// Append a name to a '\\' separated path, an empty Dir gives the name alone
+} ;
+
+// Writes the files below a directory on disk, this is what DXArchive::DecodeArchive uses
+class DXArchiveFileSystemSink : public DXArchiveSink
+{
+public :
+	DXArchiveFileSystemSink( const TCHAR *OutputPath ) ;
+
+	int					MakeDirectory( const TCHAR *Path ) override ;
+	void				*BeginFile( const TCHAR *Path, u64 Size ) override ;
+	int					Write( void *Handle, const void *Data, u64 Size ) override ;
+	int					EndFile( void *Handle, const DARC_ENTRY *Entry ) override ;
+
+protected :
+	std::wstring		OutputPath ;																// Directory the files are written to
+} ;
+
+// Keeps the files in memory, e.g., for tools that only need a few files of an archive
+class DXArchiveMemorySink : public DXArchiveSink
+{
+public :
+	int					MakeDirectory( const TCHAR *Path ) override ;
+	void				*BeginFile( const TCHAR *Path, u64 Size ) override ;
+	int					Write( void *Handle, const void *Data, u64 Size ) override ;
+	int					EndFile( void *Handle, const DARC_ENTRY *Entry ) override ;
+
+	inline const std::map<std::wstring, std::vector<u8>> &GetFiles( void ) const { return Files ; }
+	const std::vector<u8> *GetFile( const std::wstring &Path ) const ;								// Get the data of an extracted file ( NULL:not found )
+
+protected :
+	std::mutex			Mutex ;																		// Protects Files
+	std::map<std::wstring, std::vector<u8>> Files ;													// Extracted files by path
+} ;
+
+// Discards the data and only counts it, used to measure the decrypt and decompress throughput
+class DXArchiveNullSink : public DXArchiveSink
+{
+public :
+	int					MakeDirectory( const TCHAR *Path ) override ;
+	void				*BeginFile( const TCHAR *Path, u64 Size ) override ;
+	int					Write( void *Handle, const void *Data, u64 Size ) override ;
+	int					EndFile( void *Handle, const DARC_ENTRY *Entry ) override ;
+
+	inline u64			GetFileNum( void ) const { return FileNum ; }
+	inline u64			GetByteNum( void ) const { return ByteNum ; }
+
+protected :
+	std::atomic<u64>	FileNum = 0 ;																// Number of extracted files
+	std::atomic<u64>	ByteNum = 0 ;																// Number of extracted bytes
+} ;
+
+#endif
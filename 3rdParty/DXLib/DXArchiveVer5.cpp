@@ -12,11 +12,14 @@
 
 // include ----------------------------
 #include "DXArchiveVer5.h"
+#include "DXArchiveSink.h"
 #include <stdio.h>
 #include <windows.h>
 #include <stdint.h>
 #include <string.h>
 
+#include "../UberWolfLib/WolfCrypt/WolfCryptSimd.hpp"
+
 // define -----------------------------
 
 #define MIN_COMPRESS_VER5		(4)						// 最低圧縮バイト数
@@ -564,16 +567,9 @@ void DXArchive_VER5::KeyConv( void *Data, int Size, int Position, unsigned char
 	Position %= DXA_KEYSTR_LENGTH_VER5 ;
 
 #ifndef INLINE_ASM
-	int i, j ;
-
-	j = Position ;
-	for( i = 0 ; i < Size ; i ++ )
-	{
-		((u8 *)Data)[i] ^= Key[j] ;
-
-		j ++ ;
-		if( j == DXA_KEYSTR_LENGTH_VER5 ) j = 0 ;
-	}
+	// The key repeats every DXA_KEYSTR_LENGTH_VER5 bytes, so the data is XORed with a repeated key in wide blocks
+	if( Size > 0 )
+		wolf::crypt::detail::xorRepeatingKey( ( u8 * )Data, Key, DXA_KEYSTR_LENGTH_VER5, ( u32 )Position, ( size_t )Size ) ;
 #else
 	u32 DataT, SizeT ;
 	SizeT = (u32)Size ;
@@ -920,12 +916,9 @@ NOPRESS:
 }
 
 // 指定のディレクトリデータにあるファイルを展開する
-int DXArchive_VER5::DirectoryDecode( u8 *NameP, u8 *DirP, u8 *FileP, DARC_HEAD_VER5 *Head, DARC_DIRECTORY_VER5 *Dir, FILE *ArcP, unsigned char *Key )
+int DXArchive_VER5::DirectoryDecode( u8 *NameP, u8 *DirP, u8 *FileP, DARC_HEAD_VER5 *Head, DARC_DIRECTORY_VER5 *Dir, const std::wstring &OutputDir, FILE *ArcP, unsigned char *Key )
 {
-	TCHAR DirPath[MAX_PATH] ;
-	
-	// 現在のカレントディレクトリを保存
-	GetCurrentDirectory( MAX_PATH, DirPath ) ;
+	std::wstring DirPath = OutputDir ;
 
 	// ディレクトリ情報がある場合は、まず展開用のディレクトリを作成する
 	if( Dir->DirectoryAddress != 0xffffffff && Dir->ParentDirectoryAddress != 0xffffffff )
@@ -937,12 +930,8 @@ int DXArchive_VER5::DirectoryDecode( u8 *NameP, u8 *DirP, u8 *FileP, DARC_HEAD_V
 		
 		// ディレクトリの作成
 		TCHAR *pName = GetOriginalFileName(NameP + DirFile->NameAddress);
-		CreateDirectory( pName, NULL ) ;
-		delete[] pName;
-		
-		// そのディレクトリにカレントディレクトリを移す
-		pName = GetOriginalFileName(NameP + DirFile->NameAddress);
-		SetCurrentDirectory( pName ) ;
+		DirPath = DXArchiveSink::JoinPath( OutputDir, pName ) ;
+		CreateDirectory( DirPath.c_str(), NULL ) ;
 		delete[] pName;
 	}
 
@@ -960,7 +949,7 @@ int DXArchive_VER5::DirectoryDecode( u8 *NameP, u8 *DirP, u8 *FileP, DARC_HEAD_V
 			if( File->Attributes & FILE_ATTRIBUTE_DIRECTORY )
 			{
 				// ディレクトリの場合は再帰をかける
-				DirectoryDecode( NameP, DirP, FileP, Head, ( DARC_DIRECTORY_VER5 * )( DirP + File->DataAddress ), ArcP, Key ) ;
+				DirectoryDecode( NameP, DirP, FileP, Head, ( DARC_DIRECTORY_VER5 * )( DirP + File->DataAddress ), DirPath, ArcP, Key ) ;
 			}
 			else
 			{
@@ -975,7 +964,8 @@ int DXArchive_VER5::DirectoryDecode( u8 *NameP, u8 *DirP, u8 *FileP, DARC_HEAD_V
 
 				// ファイルを開く
 				TCHAR *pName = GetOriginalFileName(NameP + File->NameAddress);
-				DestP = _tfopen( pName, TEXT("wb") ) ;
+				std::wstring OutputPath = DXArchiveSink::JoinPath( DirPath, pName ) ;
+				DestP = _tfopen( OutputPath.c_str(), TEXT("wb") ) ;
 				delete[] pName;
 				
 				// データがある場合のみ転送
@@ -1056,12 +1046,9 @@ int DXArchive_VER5::DirectoryDecode( u8 *NameP, u8 *DirP, u8 *FileP, DARC_HEAD_V
 				{
 					HANDLE HFile ;
 					FILETIME CreateTime, LastAccessTime, LastWriteTime ;
-
-					TCHAR *pName = GetOriginalFileName(NameP + File->NameAddress);
-					HFile = CreateFile( pName,
+					HFile = CreateFile( OutputPath.c_str(),
 										GENERIC_WRITE, 0, NULL,
 										OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL ) ;
-					delete[] pName;
 
 					if( HFile == INVALID_HANDLE_VALUE )
 					{
@@ -1079,15 +1066,10 @@ int DXArchive_VER5::DirectoryDecode( u8 *NameP, u8 *DirP, u8 *FileP, DARC_HEAD_V
 				}
 
 				// ファイル属性を付ける
-				pName = GetOriginalFileName(NameP + File->NameAddress);
-				SetFileAttributes(pName, File->Attributes & ~(FILE_ATTRIBUTE_SYSTEM | FILE_ATTRIBUTE_HIDDEN));
-				delete[] pName;
+				SetFileAttributes( OutputPath.c_str(), File->Attributes & ~(FILE_ATTRIBUTE_SYSTEM | FILE_ATTRIBUTE_HIDDEN) ) ;
 			}
 		}
 	}
-	
-	// カレントディレクトリを元に戻す
-	SetCurrentDirectory( DirPath ) ;
 
 	// 終了
 	return 0 ;
@@ -1916,7 +1898,6 @@ int DXArchive_VER5::DecodeArchive(TCHAR *ArchiveName, const TCHAR *OutputPath, c
 	DARC_HEAD_VER5 Head ;
 	u8 *FileP, *NameP, *DirP ;
 	FILE *ArcP = NULL ;
-	TCHAR OldDir[MAX_PATH] ;
 	u8 Key[DXA_KEYSTR_LENGTH_VER5] ;
 
 	// 鍵文字列の作成
@@ -1926,10 +1907,6 @@ int DXArchive_VER5::DecodeArchive(TCHAR *ArchiveName, const TCHAR *OutputPath, c
 	ArcP = _tfopen( ArchiveName, TEXT("rb") ) ;
 	if( ArcP == NULL ) return -1 ;
 
-	// 出力先のディレクトリにカレントディレクトリを変更する
-	GetCurrentDirectory( MAX_PATH, OldDir ) ;
-	SetCurrentDirectory( OutputPath ) ;
-
 	// ヘッダを解析する
 	{
 		KeyConvFileRead( &Head, sizeof( DARC_HEAD_VER5 ), ArcP, Key, 0 ) ;
@@ -1973,7 +1950,7 @@ int DXArchive_VER5::DecodeArchive(TCHAR *ArchiveName, const TCHAR *OutputPath, c
 	}
 
 	// アーカイブの展開を開始する
-	DirectoryDecode( NameP, DirP, FileP, &Head, ( DARC_DIRECTORY_VER5 * )DirP, ArcP, Key ) ;
+	DirectoryDecode( NameP, DirP, FileP, &Head, ( DARC_DIRECTORY_VER5 * )DirP, OutputPath != NULL ? OutputPath : TEXT(""), ArcP, Key ) ;
 	
 	// ファイルを閉じる
 	fclose( ArcP ) ;
@@ -1981,9 +1958,6 @@ int DXArchive_VER5::DecodeArchive(TCHAR *ArchiveName, const TCHAR *OutputPath, c
 	// ヘッダを読み込んでいたメモリを解放する
 	free( HeadBuffer ) ;
 
-	// カレントディレクトリを元に戻す
-	SetCurrentDirectory( OldDir ) ;
-
 	// 終了
 	return 0 ;
 
@@ -1991,13 +1965,104 @@ ERR :
 	if( HeadBuffer != NULL ) free( HeadBuffer ) ;
 	if( ArcP != NULL ) fclose( ArcP ) ;
 
-	// カレントディレクトリを元に戻す
-	SetCurrentDirectory( OldDir ) ;
-
 	// 終了
 	return -1 ;
 }
 
+// Check if the key fits the archive by only decoding the header and checking that its tables are well formed,
+// much cheaper than a trial extraction when the mode of an archive has to be detected
+int DXArchive_VER5::ProbeArchive( TCHAR *ArchiveName, const char *KeyString )
+{
+	u8 *HeadBuffer = NULL ;
+	DARC_HEAD_VER5 Head ;
+	FILE *ArcP = NULL ;
+	u8 Key[DXA_KEYSTR_LENGTH_VER5] ;
+	s64 FileSize ;
+	int Result = -1 ;
+
+	// 鍵文字列の作成
+	KeyCreate( KeyString, Key ) ;
+
+	// アーカイブファイルを開く
+	ArcP = _tfopen( ArchiveName, TEXT("rb") ) ;
+	if( ArcP == NULL ) return -1 ;
+
+	_fseeki64( ArcP, 0L, SEEK_END ) ;
+	FileSize = _ftelli64( ArcP ) ;
+	_fseeki64( ArcP, 0L, SEEK_SET ) ;
+
+	// ヘッダを解析する、DecodeArchive と同じ手順
+	KeyConvFileRead( &Head, sizeof( DARC_HEAD_VER5 ), ArcP, Key, 0 ) ;
+	if( Head.Head != DXA_HEAD_VER5 )
+	{
+		// バージョン２以前か調べる
+		memset( Key, 0xffffffff, DXA_KEYSTR_LENGTH_VER5 ) ;
+
+		fseek( ArcP, 0L, SEEK_SET ) ;
+		KeyConvFileRead( &Head, sizeof( DARC_HEAD_VER5 ), ArcP, Key, 0 ) ;
+
+		if( Head.Head != DXA_HEAD_VER5 ) goto END ;
+	}
+
+	if( Head.Version > DXA_VER_VER5 ) goto END ;
+
+	// The header pack has to be inside the archive and hold the tables in order
+	if( Head.HeadSize == 0 || ( s64 )Head.FileNameTableStartAddress + Head.HeadSize > FileSize ) goto END ;
+	if( Head.FileTableStartAddress > Head.DirectoryTableStartAddress || Head.DirectoryTableStartAddress > Head.HeadSize ||
+		Head.HeadSize - Head.DirectoryTableStartAddress < sizeof( DARC_DIRECTORY_VER5 ) ) goto END ;
+
+	// ヘッダパックをメモリに読み込む
+	HeadBuffer = ( u8 * )malloc( Head.HeadSize ) ;
+	if( HeadBuffer == NULL ) goto END ;
+
+	fseek( ArcP, Head.FileNameTableStartAddress, SEEK_SET ) ;
+	if( Head.Version >= 0x0005 )
+	{
+		KeyConvFileRead( HeadBuffer, Head.HeadSize, ArcP, Key, 0 ) ;
+	}
+	else
+	{
+		KeyConvFileRead( HeadBuffer, Head.HeadSize, ArcP, Key ) ;
+	}
+
+	// Walk the flat directory table instead of recursing, so a broken header can not loop
+	{
+		const u32 NameTableSize = Head.FileTableStartAddress ;
+		const u32 FileTableSize = Head.DirectoryTableStartAddress - Head.FileTableStartAddress ;
+		const u32 DirTableSize  = Head.HeadSize - Head.DirectoryTableStartAddress ;
+		const u32 FileHeadSize  = Head.Version >= 0x0002 ? sizeof( DARC_FILEHEAD_VER5 ) : sizeof( DARC_FILEHEAD_VER1 ) ;
+		u32 i, j ;
+
+		for( i = 0 ; i + sizeof( DARC_DIRECTORY_VER5 ) <= DirTableSize ; i += sizeof( DARC_DIRECTORY_VER5 ) )
+		{
+			DARC_DIRECTORY_VER5 *Dir = ( DARC_DIRECTORY_VER5 * )( HeadBuffer + Head.DirectoryTableStartAddress + i ) ;
+
+			// ルートディレクトリには親が無い
+			if( i == 0 ? Dir->ParentDirectoryAddress != 0xffffffff : Dir->ParentDirectoryAddress >= DirTableSize ) goto END ;
+			if( Dir->FileHeadAddress > FileTableSize || Dir->FileHeadNum > ( FileTableSize - Dir->FileHeadAddress ) / FileHeadSize ) goto END ;
+
+			for( j = 0 ; j < Dir->FileHeadNum ; j ++ )
+			{
+				DARC_FILEHEAD_VER5 *File = ( DARC_FILEHEAD_VER5 * )( HeadBuffer + Head.FileTableStartAddress + Dir->FileHeadAddress + j * FileHeadSize ) ;
+
+				// 名前は４バイト単位の長さとパリティに続いて大文字版と元の名前が格納されている
+				if( File->NameAddress > NameTableSize || NameTableSize - File->NameAddress < 4 ) goto END ;
+				if( ( u32 )*( ( u16 * )( HeadBuffer + File->NameAddress ) ) * 4 * 2 > NameTableSize - File->NameAddress - 4 ) goto END ;
+
+				if( ( File->Attributes & FILE_ATTRIBUTE_DIRECTORY ) && ( File->DataAddress > DirTableSize || DirTableSize - File->DataAddress < sizeof( DARC_DIRECTORY_VER5 ) ) ) goto END ;
+			}
+		}
+	}
+
+	Result = 0 ;
+
+END :
+	if( HeadBuffer != NULL ) free( HeadBuffer ) ;
+	if( ArcP != NULL ) fclose( ArcP ) ;
+
+	return Result ;
+}
+
 
 
 // コンストラクタ
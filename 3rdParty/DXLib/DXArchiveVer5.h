@@ -16,6 +16,8 @@
 #include <stdio.h>
 #include <tchar.h>
 
+#include <string>
+
 // define ---------------------------------------
 
 // データ型定義
@@ -196,6 +198,7 @@ public :
 	static int			EncodeArchive(const TCHAR *OutputFileName, TCHAR **FileOrDirectoryPath, int FileNum, bool Press = false, const char *KeyString = NULL ) ;	// アーカイブファイルを作成する
 	static int			EncodeArchiveOneDirectory(const TCHAR *OutputFileName, const TCHAR *FolderPath, bool Press = false, const char *KeyString = NULL, u16 cryptVersion = 0); // アーカイブファイルを作成する(ディレクトリ一個だけ)
 	static int			DecodeArchive(TCHAR *ArchiveName, const TCHAR *OutputPath, const char *KeyString = NULL ) ;								// アーカイブファイルを展開する
+	static int			ProbeArchive( TCHAR *ArchiveName, const char *KeyString = NULL ) ;															// Check if the key fits by only decoding and validating the header ( 0:fits  -1:does not fit )
 
 	int					OpenArchiveFile( const TCHAR *ArchivePath, const char *KeyString = NULL ) ;				// アーカイブファイルを開く( 0:成功  -1:失敗 )
 	int					OpenArchiveFileMem( const TCHAR *ArchivePath, const char *KeyString = NULL ) ;			// アーカイブファイルを開き最初にすべてメモリ上に読み込んでから処理する( 0:成功  -1:失敗 )
@@ -269,7 +272,7 @@ protected :
 	} SEARCHDATA ;
 
 	static int DirectoryEncode(TCHAR *DirectoryName, u8 *NameP, u8 *DirP, u8 *FileP, DARC_DIRECTORY_VER5 *ParentDir, SIZESAVE *Size, int DataNumber, FILE *DestP, void *TempBuffer, bool Press, unsigned char *Key ) ;	// 指定のディレクトリにあるファイルをアーカイブデータに吐き出す
-	static int DirectoryDecode( u8 *NameP, u8 *DirP, u8 *FileP, DARC_HEAD_VER5 *Head, DARC_DIRECTORY_VER5 *Dir, FILE *ArcP, unsigned char *Key ) ;											// 指定のディレクトリデータにあるファイルを展開する
+	static int DirectoryDecode( u8 *NameP, u8 *DirP, u8 *FileP, DARC_HEAD_VER5 *Head, DARC_DIRECTORY_VER5 *Dir, const std::wstring &OutputDir, FILE *ArcP, unsigned char *Key ) ;											// 指定のディレクトリデータにあるファイルを展開する
 	static int StrICmp( const TCHAR *Str1, const TCHAR *Str2 ) ;							// 比較対照の文字列中の大文字を小文字として扱い比較する( 0:等しい  1:違う )
 	static int ConvSearchData( SEARCHDATA *Dest, const TCHAR *Src, int *Length ) ;		// 文字列を検索用のデータに変換( ヌル文字か \ があったら終了 )
 	static int AddFileNameData( const TCHAR *FileName, u8 *FileNameTable ) ;				// ファイル名データを追加する( 戻り値は使用したデータバイト数 )
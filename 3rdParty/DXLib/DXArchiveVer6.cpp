@@ -12,11 +12,14 @@
 
 // include ----------------------------
 #include "DXArchiveVer6.h"
+#include "DXArchiveSink.h"
 #include <stdio.h>
 #include <windows.h>
 #include <stdint.h>
 #include <string.h>
 
+#include "../UberWolfLib/WolfCrypt/WolfCryptSimd.hpp"
+
 // define -----------------------------
 
 #define MIN_COMPRESS		(4)						// 最低圧縮バイト数
@@ -479,34 +482,9 @@ void DXArchive_VER6::KeyCreate( const char *Source, unsigned char *Key )
 // 鍵文字列を使用して Xor 演算( Key は必ず DXA_KEYSTR_LENGTH_VER6 の長さがなければならない )
 void DXArchive_VER6::KeyConv( void *Data, s64 Size, s64 Position, unsigned char *Key )
 {
-	Position %= DXA_KEYSTR_LENGTH_VER6 ;
-
-	if( Size < 0x100000000 )
-	{
-		u32 i, j ;
-
-		j = ( u32 )Position ;
-		for( i = 0 ; i < Size ; i ++ )
-		{
-			((u8 *)Data)[i] ^= Key[j] ;
-
-			j ++ ;
-			if( j == DXA_KEYSTR_LENGTH_VER6 ) j = 0 ;
-		}
-	}
-	else
-	{
-		s64 i, j ;
-
-		j = Position ;
-		for( i = 0 ; i < Size ; i ++ )
-		{
-			((u8 *)Data)[i] ^= Key[j] ;
-
-			j ++ ;
-			if( j == DXA_KEYSTR_LENGTH_VER6 ) j = 0 ;
-		}
-	}
+	// The key repeats every DXA_KEYSTR_LENGTH_VER6 bytes, so the data is XORed with a repeated key in wide blocks
+	if( Size > 0 )
+		wolf::crypt::detail::xorRepeatingKey( ( u8 * )Data, Key, DXA_KEYSTR_LENGTH_VER6, ( u32 )( Position % DXA_KEYSTR_LENGTH_VER6 ), ( size_t )Size ) ;
 }
 
 // データを鍵文字列を使用して Xor 演算した後ファイルに書き出す関数( Key は必ず DXA_KEYSTR_LENGTH_VER6 の長さがなければならない )
@@ -776,12 +754,9 @@ NOPRESS:
 #include <vector>
 
 // 指定のディレクトリデータにあるファイルを展開する
-int DXArchive_VER6::DirectoryDecode( u8 *NameP, u8 *DirP, u8 *FileP, DARC_HEAD_VER6 *Head, DARC_DIRECTORY_VER6 *Dir, FILE *ArcP, unsigned char *Key )
+int DXArchive_VER6::DirectoryDecode( u8 *NameP, u8 *DirP, u8 *FileP, DARC_HEAD_VER6 *Head, DARC_DIRECTORY_VER6 *Dir, const std::wstring &OutputDir, FILE *ArcP, unsigned char *Key )
 {
-	TCHAR DirPath[MAX_PATH] ;
-	
-	// 現在のカレントディレクトリを保存
-	GetCurrentDirectory( MAX_PATH, DirPath ) ;
+	std::wstring DirPath = OutputDir ;
 
 	// ディレクトリ情報がある場合は、まず展開用のディレクトリを作成する
 	if( Dir->DirectoryAddress != 0xffffffffffffffff && Dir->ParentDirectoryAddress != 0xffffffffffffffff )
@@ -793,12 +768,8 @@ int DXArchive_VER6::DirectoryDecode( u8 *NameP, u8 *DirP, u8 *FileP, DARC_HEAD_V
 		
 		// ディレクトリの作成
 		TCHAR *pName = GetOriginalFileName(NameP + DirFile->NameAddress);
-		CreateDirectory( pName, NULL ) ;
-		delete[] pName;
-
-		// そのディレクトリにカレントディレクトリを移す
-		pName = GetOriginalFileName(NameP + DirFile->NameAddress);
-		SetCurrentDirectory(pName) ;
+		DirPath = DXArchiveSink::JoinPath( OutputDir, pName ) ;
+		CreateDirectory( DirPath.c_str(), NULL ) ;
 		delete[] pName;
 	}
 
@@ -816,7 +787,7 @@ int DXArchive_VER6::DirectoryDecode( u8 *NameP, u8 *DirP, u8 *FileP, DARC_HEAD_V
 			if( File->Attributes & FILE_ATTRIBUTE_DIRECTORY )
 			{
 				// ディレクトリの場合は再帰をかける
-				DirectoryDecode( NameP, DirP, FileP, Head, ( DARC_DIRECTORY_VER6 * )( DirP + File->DataAddress ), ArcP, Key ) ;
+				DirectoryDecode( NameP, DirP, FileP, Head, ( DARC_DIRECTORY_VER6 * )( DirP + File->DataAddress ), DirPath, ArcP, Key ) ;
 			}
 			else
 			{
@@ -831,8 +802,9 @@ int DXArchive_VER6::DirectoryDecode( u8 *NameP, u8 *DirP, u8 *FileP, DARC_HEAD_V
 
 				// ファイルを開く
 				TCHAR *pName = GetOriginalFileName(NameP + File->NameAddress);
+				std::wstring OutputPath = DXArchiveSink::JoinPath( DirPath, pName ) ;
 
-				DestP = _tfopen(pName, TEXT("wb"));
+				DestP = _tfopen( OutputPath.c_str(), TEXT("wb") ) ;
 
 				delete[] pName;
 			
@@ -900,11 +872,9 @@ int DXArchive_VER6::DirectoryDecode( u8 *NameP, u8 *DirP, u8 *FileP, DARC_HEAD_V
 				{
 					HANDLE HFile ;
 					FILETIME CreateTime, LastAccessTime, LastWriteTime ;
-					TCHAR *pName = GetOriginalFileName(NameP + File->NameAddress);
-					HFile = CreateFile(pName,
+					HFile = CreateFile( OutputPath.c_str(),
 										GENERIC_WRITE, 0, NULL,
 										OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL ) ;
-					delete[] pName;
 
 					if( HFile == INVALID_HANDLE_VALUE )
 					{
@@ -922,15 +892,10 @@ int DXArchive_VER6::DirectoryDecode( u8 *NameP, u8 *DirP, u8 *FileP, DARC_HEAD_V
 				}
 
 				// ファイル属性を付ける
-				pName = GetOriginalFileName(NameP + File->NameAddress);
-				SetFileAttributes(pName, (u32)File->Attributes & ~(FILE_ATTRIBUTE_SYSTEM | FILE_ATTRIBUTE_HIDDEN));
-				delete[] pName;
+				SetFileAttributes( OutputPath.c_str(), (u32)File->Attributes & ~(FILE_ATTRIBUTE_SYSTEM | FILE_ATTRIBUTE_HIDDEN) ) ;
 			}
 		}
 	}
-	
-	// カレントディレクトリを元に戻す
-	SetCurrentDirectory( DirPath ) ;
 
 	// 終了
 	return 0 ;
@@ -1761,7 +1726,6 @@ int DXArchive_VER6::DecodeArchive(TCHAR *ArchiveName, const TCHAR *OutputPath, c
 	DARC_HEAD_VER6 Head ;
 	u8 *FileP, *NameP, *DirP ;
 	FILE *ArcP = NULL ;
-	TCHAR OldDir[MAX_PATH] ;
 	u8 Key[DXA_KEYSTR_LENGTH_VER6] ;
 
 	// 鍵文字列の作成
@@ -1771,10 +1735,6 @@ int DXArchive_VER6::DecodeArchive(TCHAR *ArchiveName, const TCHAR *OutputPath, c
 	ArcP = _tfopen( ArchiveName, TEXT("rb") ) ;
 	if( ArcP == NULL ) return -1 ;
 
-	// 出力先のディレクトリにカレントディレクトリを変更する
-	GetCurrentDirectory( MAX_PATH, OldDir ) ;
-	SetCurrentDirectory( OutputPath ) ;
-
 	// ヘッダを解析する
 	{
 		KeyConvFileRead( &Head, sizeof( DARC_HEAD_VER6 ), ArcP, Key, 0 ) ;
@@ -1801,7 +1761,7 @@ int DXArchive_VER6::DecodeArchive(TCHAR *ArchiveName, const TCHAR *OutputPath, c
 	}
 
 	// アーカイブの展開を開始する
-	DirectoryDecode( NameP, DirP, FileP, &Head, ( DARC_DIRECTORY_VER6 * )DirP, ArcP, Key ) ;
+	DirectoryDecode( NameP, DirP, FileP, &Head, ( DARC_DIRECTORY_VER6 * )DirP, OutputPath != NULL ? OutputPath : TEXT(""), ArcP, Key ) ;
 	
 	// ファイルを閉じる
 	fclose( ArcP ) ;
@@ -1809,9 +1769,6 @@ int DXArchive_VER6::DecodeArchive(TCHAR *ArchiveName, const TCHAR *OutputPath, c
 	// ヘッダを読み込んでいたメモリを解放する
 	free( HeadBuffer ) ;
 
-	// カレントディレクトリを元に戻す
-	SetCurrentDirectory( OldDir ) ;
-
 	// 終了
 	return 0 ;
 
@@ -1819,13 +1776,86 @@ ERR :
 	if( HeadBuffer != NULL ) free( HeadBuffer ) ;
 	if( ArcP != NULL ) fclose( ArcP ) ;
 
-	// カレントディレクトリを元に戻す
-	SetCurrentDirectory( OldDir ) ;
-
 	// 終了
 	return -1 ;
 }
 
+// Check if the key fits the archive by only decoding the header and checking that its tables are well formed,
+// much cheaper than a trial extraction when the mode of an archive has to be detected
+int DXArchive_VER6::ProbeArchive( TCHAR *ArchiveName, const char *KeyString )
+{
+	u8 *HeadBuffer = NULL ;
+	DARC_HEAD_VER6 Head ;
+	FILE *ArcP = NULL ;
+	u8 Key[DXA_KEYSTR_LENGTH_VER6] ;
+	s64 FileSize ;
+	int Result = -1 ;
+
+	// 鍵文字列の作成
+	KeyCreate( KeyString, Key ) ;
+
+	// アーカイブファイルを開く
+	ArcP = _tfopen( ArchiveName, TEXT("rb") ) ;
+	if( ArcP == NULL ) return -1 ;
+
+	_fseeki64( ArcP, 0L, SEEK_END ) ;
+	FileSize = _ftelli64( ArcP ) ;
+	_fseeki64( ArcP, 0L, SEEK_SET ) ;
+
+	// ヘッダを解析する、DecodeArchive と同じ手順
+	KeyConvFileRead( &Head, sizeof( DARC_HEAD_VER6 ), ArcP, Key, 0 ) ;
+	if( Head.Head != DXA_HEAD_VER6 ) goto END ;
+	if( Head.Version > DXA_VER_VER6 || Head.Version < 0x0006 ) goto END ;
+
+	// The header pack has to be inside the archive and hold the tables in order
+	if( Head.HeadSize == 0 || Head.FileNameTableStartAddress > ( u64 )FileSize || Head.HeadSize > ( u64 )FileSize - Head.FileNameTableStartAddress ) goto END ;
+	if( Head.FileTableStartAddress > Head.DirectoryTableStartAddress || Head.DirectoryTableStartAddress > Head.HeadSize ||
+		Head.HeadSize - Head.DirectoryTableStartAddress < sizeof( DARC_DIRECTORY_VER6 ) ) goto END ;
+
+	// ヘッダパックをメモリに読み込む
+	HeadBuffer = ( u8 * )malloc( ( size_t )Head.HeadSize ) ;
+	if( HeadBuffer == NULL ) goto END ;
+
+	_fseeki64( ArcP, Head.FileNameTableStartAddress, SEEK_SET ) ;
+	KeyConvFileRead( HeadBuffer, Head.HeadSize, ArcP, Key, 0 ) ;
+
+	// Walk the flat directory table instead of recursing, so a broken header can not loop
+	{
+		const u64 NameTableSize = Head.FileTableStartAddress ;
+		const u64 FileTableSize = Head.DirectoryTableStartAddress - Head.FileTableStartAddress ;
+		const u64 DirTableSize  = Head.HeadSize - Head.DirectoryTableStartAddress ;
+		u64 i, j ;
+
+		for( i = 0 ; i + sizeof( DARC_DIRECTORY_VER6 ) <= DirTableSize ; i += sizeof( DARC_DIRECTORY_VER6 ) )
+		{
+			DARC_DIRECTORY_VER6 *Dir = ( DARC_DIRECTORY_VER6 * )( HeadBuffer + Head.DirectoryTableStartAddress + i ) ;
+
+			// ルートディレクトリには親が無い
+			if( i == 0 ? Dir->ParentDirectoryAddress != 0xffffffffffffffff : Dir->ParentDirectoryAddress >= DirTableSize ) goto END ;
+			if( Dir->FileHeadAddress > FileTableSize || Dir->FileHeadNum > ( FileTableSize - Dir->FileHeadAddress ) / sizeof( DARC_FILEHEAD_VER6 ) ) goto END ;
+
+			for( j = 0 ; j < Dir->FileHeadNum ; j ++ )
+			{
+				DARC_FILEHEAD_VER6 *File = ( DARC_FILEHEAD_VER6 * )( HeadBuffer + Head.FileTableStartAddress + Dir->FileHeadAddress + j * sizeof( DARC_FILEHEAD_VER6 ) ) ;
+
+				// 名前は４バイト単位の長さとパリティに続いて大文字版と元の名前が格納されている
+				if( File->NameAddress > NameTableSize || NameTableSize - File->NameAddress < 4 ) goto END ;
+				if( ( u64 )*( ( u16 * )( HeadBuffer + File->NameAddress ) ) * 4 * 2 > NameTableSize - File->NameAddress - 4 ) goto END ;
+
+				if( ( File->Attributes & FILE_ATTRIBUTE_DIRECTORY ) && ( File->DataAddress > DirTableSize || DirTableSize - File->DataAddress < sizeof( DARC_DIRECTORY_VER6 ) ) ) goto END ;
+			}
+		}
+	}
+
+	Result = 0 ;
+
+END :
+	if( HeadBuffer != NULL ) free( HeadBuffer ) ;
+	if( ArcP != NULL ) fclose( ArcP ) ;
+
+	return Result ;
+}
+
 
 
 // コンストラクタ
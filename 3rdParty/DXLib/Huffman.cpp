@@ -499,6 +499,14 @@ u64 Huffman_Encode( void *Src, u64 SrcSize, void *Dest )
 //
 // 戻り値:解凍後のサイズ  0 はエラー  Dest に NULL を入れると解凍データ格納に必要なサイズが返る
 u64 Huffman_Decode( void *Press, void *Dest )
+{
+	return Huffman_DecodeChecked( Press, HUFFMAN_UNCHECKED, Dest, HUFFMAN_UNCHECKED ) ;
+}
+
+// 圧縮データを解凍、PressBufferSize と DestBufferSize を超えて読み書きしない
+//
+// 戻り値:解凍後のサイズ  0 はエラー( 壊れたデータや鍵の間違いを含む )  Dest に NULL を入れると解凍データ格納に必要なサイズが返る
+u64 Huffman_DecodeChecked( const void *Press, u64 PressBufferSize, void *Dest, u64 DestBufferSize )
 {
     // 結合データと数値データ、０～２５５までが数値データ
     HUFFMAN_NODE Node[256 + 255] ;
@@ -507,14 +515,24 @@ u64 Huffman_Decode( void *Press, void *Dest )
     unsigned char *PressPoint, *DestPoint ;
 	u64 OriginalSize ;
 	u64 PressSize ;
+	u64 PressLimit ;
 	u64 HeadSize ;
 	u16 Weight[ 256 ] ;
+	u8 HeadTemp[ HUFFMAN_MAXHEADSIZE ] ;
     int i ;
 
     // void 型のポインタではアドレスの操作が出来ないので unsigned char 型のポインタにする
     PressPoint = ( unsigned char * )Press ;
     DestPoint = ( unsigned char * )Dest ;
 
+	// The header is read bit by bit without checks, parse a zero padded copy when the buffer could end inside of it
+	if( PressBufferSize < HUFFMAN_MAXHEADSIZE )
+	{
+		memset( HeadTemp, 0, sizeof( HeadTemp ) ) ;
+		memcpy( HeadTemp, Press, ( size_t )PressBufferSize ) ;
+		PressPoint = HeadTemp ;
+	}
+
     // 圧縮データの情報を取得する
 	{
 		BIT_STREAM BitStream ;
@@ -542,11 +560,21 @@ u64 Huffman_Decode( void *Press, void *Dest )
 
 		HeadSize = BitStream_GetBytes( &BitStream ) ;
 	}
+
+	// The compressed data has to be inside the buffer
+	PressPoint = ( unsigned char * )Press ;
+	if( HeadSize > PressBufferSize || PressSize > PressBufferSize - HeadSize )
+		return 0 ;
+	PressLimit = PressSize ;
     
     // Dest が NULL の場合は 解凍後のデータのサイズを返す
     if( Dest == NULL )
         return OriginalSize ;
 
+	// The decoded data has to fit into the output buffer
+	if( OriginalSize > DestBufferSize || OriginalSize == 0 )
+		return 0 ;
+
     // 解凍後のデータのサイズを取得する
     DestSize = OriginalSize ;
 
@@ -558,7 +586,7 @@ u64 Huffman_Decode( void *Press, void *Dest )
         // 数値データを初期化する
         for( i = 0 ; i < 256 + 255 ; i ++ )
         {
-            Node[i].Weight = Weight[i] ;    // 出現数は保存しておいたデータからコピー
+            Node[i].Weight = i < 256 ? Weight[i] : 0 ;    // 出現数は保存しておいたデータからコピー、結合データは後で算出する
             Node[i].ChildNode[0] = -1 ;    // 数値データが終点なので -1 をセットする
             Node[i].ChildNode[1] = -1 ;    // 数値データが終点なので -1 をセットする
             Node[i].ParentNode = -1 ;      // まだどの要素とも結合されていないので -1 をセットする
@@ -782,6 +810,7 @@ u64 Huffman_Decode( void *Press, void *Dest )
         PressBitCounter = 0 ;
         
         // 圧縮データの１バイト目をセット
+		if( PressLimit == 0 ) return 0 ;
         PressBitData = PressData[PressSizeCounter] ;
 
         // 圧縮前のデータサイズになるまで解凍処理を繰り返す
@@ -790,7 +819,8 @@ u64 Huffman_Decode( void *Press, void *Dest )
             // ビット列から数値データを検索する
             {
 				// 最後の17byte分のデータは天辺から探す( 最後の次のバイトを読み出そうとしてメモリの不正なアクセスになる可能性があるため )
-				if( DestSizeCounter >= DestSize - 17 )
+				// ( DestSize - 17 would wrap around for data shorter than 17 bytes )
+				if( DestSizeCounter + 17 >= DestSize )
 				{
 					// 結合データの天辺は一番最後の結合データが格納される５１０番目(０番から数える)
 					// 天辺から順に下に降りていく
@@ -806,11 +836,13 @@ u64 Huffman_Decode( void *Press, void *Dest )
                     if( PressBitCounter == 8 )
                     {
                         PressSizeCounter ++ ;
+						if( PressSizeCounter >= PressLimit ) return 0 ;
                         PressBitData = PressData[PressSizeCounter] ;
                         PressBitCounter = 0 ;
                     }
 
 					// 圧縮データを9bit分用意する
+					if( PressSizeCounter + 1 >= PressLimit ) return 0 ;
 					PressBitData = ( PressBitData | ( PressData[ PressSizeCounter + 1 ] << ( 8 - PressBitCounter ) ) ) & 0x1ff ;
 
 					// テーブルから最初の結合データを探す
@@ -822,6 +854,7 @@ u64 Huffman_Decode( void *Press, void *Dest )
 					{
 						PressSizeCounter += 2 ;
 						PressBitCounter -= 16 ;
+						if( PressSizeCounter >= PressLimit ) return 0 ;
 						PressBitData = PressData[PressSizeCounter] >> PressBitCounter ;
 					}
 					else
@@ -829,6 +862,7 @@ u64 Huffman_Decode( void *Press, void *Dest )
 					{
 						PressSizeCounter ++ ;
 						PressBitCounter -= 8 ;
+						if( PressSizeCounter >= PressLimit ) return 0 ;
 						PressBitData = PressData[PressSizeCounter] >> PressBitCounter ;
 					}
 					else
@@ -846,6 +880,7 @@ u64 Huffman_Decode( void *Press, void *Dest )
                     if( PressBitCounter == 8 )
                     {
                         PressSizeCounter ++ ;
+						if( PressSizeCounter >= PressLimit ) return 0 ;
                         PressBitData = PressData[PressSizeCounter] ;
                         PressBitCounter = 0 ;
                     }
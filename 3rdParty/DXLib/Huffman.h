@@ -42,6 +42,9 @@
 #define NULL	(0)
 #endif
 
+#define HUFFMAN_MAXHEADSIZE		(1024)				// Upper bound of the size information and the frequency table in front of the compressed data
+#define HUFFMAN_UNCHECKED		(~0ULL)				// Buffer size for Huffman_DecodeChecked when the size is not known
+
 // proto type -----------------------------------
 
 // データを圧縮
@@ -52,4 +55,8 @@ extern u64 Huffman_Encode( void *Src, u64 SrcSize, void *Dest ) ;
 // 戻り値:解凍後のサイズ  0 はエラー  Dest に NULL を入れると解凍データ格納に必要なサイズが返る
 extern u64 Huffman_Decode( void *Press, void *Dest ) ;
 
+// 圧縮データを解凍、PressBufferSize バイトより後ろを読まず DestBufferSize バイトより後ろに書き込まない
+// 戻り値:解凍後のサイズ  0 はエラー( 壊れたデータや鍵の間違いを含む )  Dest に NULL を入れると解凍データ格納に必要なサイズが返る
+extern u64 Huffman_DecodeChecked( const void *Press, u64 PressBufferSize, void *Dest, u64 DestBufferSize ) ;
+
 #endif // HUFFMAN_H
\ No newline at end of file
@@ -40,9 +40,9 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance, _In_opt_ [[maybe_unused]] HINSTA
 {
 	try
 	{
-		// For the archive extraction a subprocess is created, which will be terminated after the extraction is done.
+		// The old archive versions are extracted by worker subprocesses, which run until the parent closes their job pipe.
 		// Therefore, check if the current process is a subprocess and if so, create an instance of UberWolfLib which will
-		// directly call the unpack function and then terminate the process
+		// run the extraction jobs and then terminate the process
 		if (IsSubProcess())
 		{
 			[[maybe_unused]] UberWolfLib uwl;
@@ -28,11 +28,13 @@
 #include <filesystem>
 #include <format>
 #include <iostream>
+#include <nlohmann/json.hpp>
 #include <vector>
 #include <windows.h>
 
 #include <UberWolfLib.h>
 #include <Utils.h>
+#include <WolfUtils.h>
 
 #include <SelfUpdater/SelfUpdater.hpp>
 
@@ -54,6 +56,91 @@ std::string buildPackInfo()
 	return info;
 }
 
+std::string toUtf8(const std::wstring& wstr)
+{
+	if (wstr.empty())
+		return "";
+
+	const int size = WideCharToMultiByte(CP_UTF8, 0, wstr.c_str(), static_cast<int>(wstr.size()), nullptr, 0, nullptr, nullptr);
+	std::string str(size, '\0');
+	WideCharToMultiByte(CP_UTF8, 0, wstr.c_str(), static_cast<int>(wstr.size()), str.data(), size, nullptr, nullptr);
+
+	return str;
+}
+
+std::string formatSize(const uint64_t& size)
+{
+	// Sizes of 0xFFFFFFFFFFFFFFFF mark data that is not compressed
+	return (size == 0xFFFFFFFFFFFFFFFF ? "-" : std::to_string(size));
+}
+
+int listArchives(UberWolfLib& uwl, const tStrings& paths, const bool& json)
+{
+	nlohmann::ordered_json j = nlohmann::ordered_json::array();
+	int ret                  = 0;
+
+	SetConsoleOutputCP(CP_UTF8);
+
+	for (const tString& path : paths)
+	{
+		ArchiveEntries entries;
+
+		if (!IsWolfExtension(fs::path(path).extension()))
+			continue;
+
+		const UWLExitCode result = uwl.ListArchive(path, entries);
+		if (result != UWLExitCode::SUCCESS)
+		{
+			std::cerr << "ListArchive failed for " << toUtf8(path) << " with exit code: " << static_cast<int>(result) << std::endl;
+			ret = -1;
+			continue;
+		}
+
+		if (json)
+		{
+			nlohmann::ordered_json archive;
+			archive["archive"] = toUtf8(path);
+			archive["entries"] = nlohmann::ordered_json::array();
+
+			for (const ArchiveEntry& entry : entries)
+			{
+				nlohmann::ordered_json e;
+				e["path"]      = toUtf8(entry.path);
+				e["directory"] = entry.directory;
+
+				if (!entry.directory)
+				{
+					e["size"]        = entry.size;
+					e["lzSize"]      = (entry.pressSize == 0xFFFFFFFFFFFFFFFF ? nlohmann::ordered_json() : nlohmann::ordered_json(entry.pressSize));
+					e["huffmanSize"] = (entry.huffPressSize == 0xFFFFFFFFFFFFFFFF ? nlohmann::ordered_json() : nlohmann::ordered_json(entry.huffPressSize));
+					e["offset"]      = entry.offset;
+				}
+
+				archive["entries"].push_back(e);
+			}
+
+			j.push_back(archive);
+			continue;
+		}
+
+		std::cout << toUtf8(path) << std::endl;
+		std::cout << std::format("{:>14} {:>14} {:>14} {:>14}  {}", "Offset", "Size", "LZ", "Huffman", "Path") << std::endl;
+
+		for (const ArchiveEntry& entry : entries)
+		{
+			if (entry.directory)
+				std::cout << std::format("{:>14} {:>14} {:>14} {:>14}  {}\\", "", "", "", "", toUtf8(entry.path)) << std::endl;
+			else
+				std::cout << std::format("{:>14} {:>14} {:>14} {:>14}  {}", entry.offset, entry.size, formatSize(entry.pressSize), formatSize(entry.huffPressSize), toUtf8(entry.path)) << std::endl;
+		}
+	}
+
+	if (json)
+		std::cout << j.dump(4) << std::endl;
+
+	return ret;
+}
+
 int main(int argc, char* argv[])
 {
 	if (IsSubProcess())
@@ -82,6 +169,24 @@ int main(int argc, char* argv[])
 	std::string packVersion = "";
 	app.add_option("-p,--pack", packVersion, buildPackInfo())->type_name("VER_IDX");
 
+	bool list = false;
+	app.add_flag("-l,--list", list, "List the content of the archives without extracting them");
+
+	bool json = false;
+	app.add_flag("--json", json, "Print the archive list as JSON")->needs("--list");
+
+	tStrings include;
+	app.add_option("-i,--include", include, "Only extract entries matching the glob pattern, e.g., BasicData or *.mps")->type_name("PATTERN")->allow_extra_args(false);
+
+	tStrings exclude;
+	app.add_option("-e,--exclude", exclude, "Skip entries matching the glob pattern")->type_name("PATTERN")->allow_extra_args(false);
+
+	std::size_t jobs = 1;
+	app.add_option("-j,--jobs", jobs, "Number of archives to unpack at once, 0 uses one per hardware thread")->type_name("N");
+
+	std::size_t threads = 0;
+	app.add_option("-t,--threads", threads, "Number of threads extracting the entries of an archive, 0 uses one per hardware thread")->type_name("N");
+
 	CLI11_PARSE(app, argc, argv);
 
 	const tStrings zeroArg = { StringToWString(argv[0]) };
@@ -94,6 +199,9 @@ int main(int argc, char* argv[])
 	}
 
 	uwl.Configure(override, unprotect, decWolfX);
+	uwl.SetEntryFilters(include, exclude);
+	uwl.SetJobCount(jobs);
+	uwl.SetThreadCount(threads);
 
 	try
 	{
@@ -101,6 +209,12 @@ int main(int argc, char* argv[])
 		// Check if the first argument is an executable
 		if (fs::exists(files.front()) && fs::is_regular_file(files.front()) && fs::path(files.front()).extension() == ".exe")
 		{
+			if (list)
+			{
+				std::cerr << "[ERROR] Listing only works on archives or a data folder" << std::endl;
+				return -1;
+			}
+
 			if (!uwl.InitGame(files.front()))
 			{
 				std::cerr << "Failed to initialize game with the provided executable." << std::endl;
@@ -192,6 +306,9 @@ int main(int argc, char* argv[])
 			return -1;
 		}
 
+		if (list)
+			return listArchives(uwl, paths, json);
+
 		result = uwl.UnpackDataVec(paths);
 
 		if (result != UWLExitCode::SUCCESS)
@@ -0,0 +1,201 @@
+/*
+ *  File: ArchiveCache.cpp
+ *  Copyright (c) 2025 Sinflower
+ *
+ *  MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ */
+
+#include "ArchiveCache.h"
+
+#include <algorithm>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <windows.h>
+
+#include "Utils.h"
+
+namespace fs = std::filesystem;
+
+// Number of bytes at the start of the archive that go into the fingerprint, covers the archive header and the start of the data
+static constexpr std::size_t FINGERPRINT_HEAD_SIZE = 4096;
+
+// FNV-1a, only has to tell apart archives that share size and modification time
+static uint64_t hashBytes(const uint8_t* pData, const std::size_t& size)
+{
+	uint64_t hash = 0xCBF29CE484222325;
+
+	for (std::size_t i = 0; i < size; i++)
+	{
+		hash ^= pData[i];
+		hash *= 0x100000001B3;
+	}
+
+	return hash;
+}
+
+ArchiveCache::ArchiveCache() :
+	m_cachePath(fs::absolute(CACHE_FILE_NAME)) // Resolved once, packing changes the working directory
+{
+	load();
+}
+
+ArchiveCache::~ArchiveCache()
+{
+	if (m_dirty)
+		save();
+}
+
+bool ArchiveCache::Lookup(const tString& filePath, ArchiveCacheEntry& entry)
+{
+	const std::string fingerprint = Fingerprint(filePath);
+	if (fingerprint.empty())
+		return false;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (!m_data["archives"].contains(fingerprint))
+		return false;
+
+	try
+	{
+		const nlohmann::ordered_json& value = m_data["archives"][fingerprint];
+
+		entry.name         = value.at("name");
+		entry.decoder      = value.at("decoder");
+		entry.cryptVersion = value.at("cryptVersion");
+
+		entry.key.clear();
+		for (const auto& v : value.at("key"))
+			entry.key.push_back(static_cast<uint8_t>(std::stoul(std::string(v), nullptr, 16)));
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+void ArchiveCache::Store(const tString& filePath, const ArchiveCacheEntry& entry)
+{
+	const std::string fingerprint = Fingerprint(filePath);
+	if (fingerprint.empty())
+		return;
+
+	nlohmann::ordered_json value;
+	value["name"]         = entry.name;
+	value["decoder"]      = entry.decoder;
+	value["cryptVersion"] = entry.cryptVersion;
+	// Write the key as an array of 0x prefixed hex strings, like the config file
+	value["key"] = nlohmann::json::array();
+	for (const uint8_t& byte : entry.key)
+		value["key"].push_back("0x" + ByteToHexString(byte));
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// Every archive of a game is stored after each run, only write the file if something changed
+	if (m_data["archives"].contains(fingerprint) && m_data["archives"][fingerprint] == value)
+		return;
+
+	m_data["archives"][fingerprint] = value;
+	m_dirty                         = true;
+}
+
+std::string ArchiveCache::Fingerprint(const tString& filePath)
+{
+	std::error_code ec;
+
+	const uintmax_t size = fs::file_size(filePath, ec);
+	if (ec)
+		return "";
+
+	const fs::file_time_type mtime = fs::last_write_time(filePath, ec);
+	if (ec)
+		return "";
+
+	std::ifstream f(fs::path(filePath), std::ios::binary);
+	if (!f.is_open())
+		return "";
+
+	std::vector<uint8_t> head(static_cast<std::size_t>(std::min<uintmax_t>(size, FINGERPRINT_HEAD_SIZE)));
+	if (!f.read(reinterpret_cast<char*>(head.data()), head.size()))
+		return "";
+
+	return std::format("{:x}-{:x}-{:016x}", size, static_cast<uint64_t>(mtime.time_since_epoch().count()), hashBytes(head.data(), head.size()));
+}
+
+void ArchiveCache::load()
+{
+	m_data["archives"] = nlohmann::ordered_json::object();
+
+	// Return if the cache file does not exist or is empty
+	if (!fs::exists(m_cachePath) || fs::file_size(m_cachePath) == 0)
+		return;
+
+	try
+	{
+		std::ifstream f(m_cachePath);
+		nlohmann::ordered_json data = nlohmann::ordered_json::parse(f);
+
+		if (data.contains("archives") && data["archives"].is_object())
+			m_data["archives"] = data["archives"];
+	}
+	catch (const std::exception& e)
+	{
+		// A damaged cache is simply rebuilt
+		std::cerr << e.what() << std::endl;
+	}
+}
+
+void ArchiveCache::save() const
+{
+	// Write to a temporary file first and replace the cache with it, so an interrupted write or a second
+	// instance writing at the same time never leaves a truncated cache behind
+	fs::path tmpPath = m_cachePath;
+	tmpPath += std::format(".{}.tmp", GetCurrentProcessId());
+
+	std::error_code ec;
+
+	{
+		std::ofstream f(tmpPath);
+		f << m_data.dump(4);
+
+		if (!f.flush())
+		{
+			std::cerr << std::format("Failed to write {}", tmpPath.string()) << std::endl;
+			f.close();
+			fs::remove(tmpPath, ec);
+			return;
+		}
+	}
+
+	fs::rename(tmpPath, m_cachePath, ec);
+
+	if (ec)
+	{
+		std::cerr << ec.message() << std::endl;
+		fs::remove(tmpPath, ec);
+	}
+}
@@ -0,0 +1,77 @@
+/*
+ *  File: ArchiveCache.h
+ *  Copyright (c) 2025 Sinflower
+ *
+ *  MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+
+#include <nlohmann/json.hpp>
+
+#include "Types.h"
+
+// Crypt mode an archive was last extracted with
+struct ArchiveCacheEntry
+{
+	std::string name;      // Name of the mode, only used to reuse an already known mode
+	std::string decoder;   // Archive version, "VER5", "VER6" or "VER8", the same values as in the config file
+	uint16_t cryptVersion; // Crypt version of the mode, 0x0 for keys from the config file
+	Key key;               // Key including the terminating 0x00
+};
+
+// Remembers the winning crypt mode per archive, so re-runs on the same game skip the mode detection and the Pro key derivation.
+// Archives are identified by a fingerprint of their size, modification time and header bytes, so a modified or replaced archive is detected again
+class ArchiveCache
+{
+public:
+	inline static const std::string CACHE_FILE_NAME = "UberWolfCache.json";
+
+public:
+	ArchiveCache();
+	~ArchiveCache();
+
+	ArchiveCache(const ArchiveCache&)            = delete;
+	ArchiveCache& operator=(const ArchiveCache&) = delete;
+
+	bool Lookup(const tString& filePath, ArchiveCacheEntry& entry);
+	// Only updates the cache in memory, the file is written once when the cache is destroyed
+	void Store(const tString& filePath, const ArchiveCacheEntry& entry);
+
+	// Empty if the file could not be read
+	static std::string Fingerprint(const tString& filePath);
+
+private:
+	void load();
+	void save() const;
+
+private:
+	std::filesystem::path m_cachePath;
+	nlohmann::ordered_json m_data;
+	bool m_dirty = false;
+	std::mutex m_mutex; // Archives of a game are extracted on several threads
+};
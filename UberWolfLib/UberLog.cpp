@@ -48,4 +48,6 @@ void UberLog::log(T& msg)
 }
 */
 
-std::mutex UberLog::s_mtx = std::mutex();
\ No newline at end of file
+std::mutex UberLog::s_mtx = std::mutex();
+
+thread_local uberLog::Capture* UberLog::s_pCapture = nullptr;
\ No newline at end of file
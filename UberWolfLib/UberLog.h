@@ -28,13 +28,20 @@
 
 #include <format>
 #include <mutex>
+#include <utility>
+#include <vector>
 
 #include "Types.h"
 
+class UberLog;
+
 namespace uberLog
 {
 extern LogCallbacks s_logCallbacks;
-}
+
+// Messages a thread logged while capturing, in order together with the log they were meant for
+using Capture = std::vector<std::pair<UberLog*, tString>>;
+} // namespace uberLog
 
 class UberLog
 {
@@ -48,19 +55,45 @@ public:
 
 	template<typename T>
 	void log(T& msg)
+	{
+		if (s_pCapture)
+			s_pCapture->push_back({ this, msg.str() });
+		else
+			write(msg.str());
+
+		msg.flush();
+	}
+
+	void write(const tString& str)
 	{
 		std::lock_guard<std::mutex> lock(s_mtx);
-		m_oStream << msg.str();
+		m_oStream << str;
 
 		for (auto& callback : uberLog::s_logCallbacks)
-			callback(msg.str(), false);
+			callback(str, false);
+	}
 
-		msg.flush();
+	// Keep the messages of the calling thread instead of writing them, so parallel jobs can be logged one after another
+	static void BeginCapture(uberLog::Capture* pCapture)
+	{
+		s_pCapture = pCapture;
+	}
+
+	static void EndCapture()
+	{
+		s_pCapture = nullptr;
+	}
+
+	static void Replay(const uberLog::Capture& capture)
+	{
+		for (const auto& [pLog, str] : capture)
+			pLog->write(str);
 	}
 
 private:
 	tOstream& m_oStream;
 	static std::mutex s_mtx;
+	static thread_local uberLog::Capture* s_pCapture;
 };
 
 class UberLogBuffer
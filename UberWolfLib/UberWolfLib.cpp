@@ -33,10 +33,14 @@
 #include "WolfUtils.h"
 #include "resource.h"
 
+#include <atomic>
+#include <condition_variable>
 #include <eh.h>
 #include <filesystem>
 #include <format>
 #include <fstream>
+#include <mutex>
+#include <thread>
 #include <nlohmann/json.hpp>
 
 #include <SelfUpdater/Version.hpp>
@@ -61,42 +65,42 @@ UberWolfLib::UberWolfLib(const tStrings& argv) :
 	if (argv.size() < 1)
 		throw std::runtime_error("UberWolfLib: Invalid arguments count");
 
-	uint32_t mode     = -1;
-	tString path      = TEXT("");
 	bool isSubProcess = IsSubProcess();
-	bool override     = false;
+	HANDLE jobPipe    = nullptr;
+	HANDLE resultPipe = nullptr;
 
 	if (isSubProcess && argv.size() >= 3)
 	{
 		for (std::size_t i = 0; i < argv.size(); i++)
 		{
-			if (argv[i] == TEXT("-m"))
+			// Worker of the extraction worker pool, the arguments are the inherited pipe handles
+			if (argv[i] == WorkerPool::WORKER_ARG)
 			{
 				if (i + 2 >= argv.size())
-					throw std::runtime_error("UberWolfLib: -m argument requires two values");
+					throw std::runtime_error("UberWolfLib: -w argument requires two values");
 
-				mode = std::stoi(WStringToString(argv[i + 1]));
-				path = argv[i + 2];
-
-				if (argv.size() > i + 3)
-					override = (argv[i + 3] == TEXT("-o"));
+				jobPipe    = reinterpret_cast<HANDLE>(static_cast<uintptr_t>(std::stoull(WStringToString(argv[i + 1]))));
+				resultPipe = reinterpret_cast<HANDLE>(static_cast<uintptr_t>(std::stoull(WStringToString(argv[i + 2]))));
 				break;
 			}
 		}
 	}
 
-	m_wolfDec = WolfDec(argv[0], mode, isSubProcess);
+	m_wolfDec = WolfDec(argv[0], -1, isSubProcess);
 
 	if (isSubProcess)
 	{
 		// Add a new exception translator, this allows for proper catching of potential access violations
 		_set_se_translator([]([[maybe_unused]] unsigned int u, [[maybe_unused]] EXCEPTION_POINTERS* pExp) { throw std::exception(""); });
 
-		// For subprocess calls the mode was passed as an argument
-		// directly call unpack, which in this case will also terminate the process
+		// Subprocesses are only started as workers of the extraction worker pool.
+		// Workers run jobs until the pool closes the job pipe, a crash ends the process and the pool replaces it
+		if (jobPipe == nullptr)
+			ExitProcess(1);
+
 		try
 		{
-			m_wolfDec.UnpackArchive(path.c_str(), override);
+			m_wolfDec.RunWorker(jobPipe, resultPipe);
 		}
 		catch ([[maybe_unused]] const std::exception& e)
 		{
@@ -196,16 +200,27 @@ UWLExitCode UberWolfLib::UnpackData()
 
 UWLExitCode UberWolfLib::UnpackDataVec(const tStrings& paths)
 {
+	tStrings archives;
+
 	for (const tString& p : paths)
 	{
 		if (IsWolfExtension(fs::path(p).extension()))
-		{
-			UWLExitCode uec = unpackArchive(p);
-			if (uec != UWLExitCode::SUCCESS) return uec;
-		}
+			archives.push_back(p);
 	}
 
-	return UWLExitCode::SUCCESS;
+	std::size_t idx = 0;
+
+	// Archives are unpacked one after another until one decided the mode, which can include searching the key
+	for (; idx < archives.size() && (m_config.jobs == 1 || !m_wolfDec.IsModeSet()); idx++)
+	{
+		UWLExitCode uec = unpackArchive(archives[idx]);
+		if (uec != UWLExitCode::SUCCESS) return uec;
+	}
+
+	if (idx == archives.size())
+		return UWLExitCode::SUCCESS;
+
+	return unpackParallel(tStrings(archives.begin() + idx, archives.end()));
 }
 
 UWLExitCode UberWolfLib::UnpackArchive(const tString& archivePath)
@@ -213,6 +228,30 @@ UWLExitCode UberWolfLib::UnpackArchive(const tString& archivePath)
 	return unpackArchive(archivePath);
 }
 
+UWLExitCode UberWolfLib::ListArchive(const tString& archivePath, ArchiveEntries& entries)
+{
+	if (archivePath.empty())
+		return UWLExitCode::INVALID_PATH;
+
+	if (!fs::exists(archivePath))
+		return UWLExitCode::FILE_NOT_FOUND;
+
+	if (!m_wolfDec)
+		return UWLExitCode::WOLF_DEC_NOT_INITIALIZED;
+
+	if (m_wolfDec.ListArchive(archivePath, entries))
+		return UWLExitCode::SUCCESS;
+
+	// Pro archives can only be read with the key of the game
+	if (!m_valid && !findGameFromArchive(archivePath))
+		return UWLExitCode::NOT_INITIALIZED;
+
+	if (FindDxArcKey(true) == UWLExitCode::SUCCESS && m_wolfDec.ListArchive(archivePath, entries))
+		return UWLExitCode::SUCCESS;
+
+	return UWLExitCode::KEY_MISSING;
+}
+
 UWLExitCode UberWolfLib::FindDxArcKey(const bool& quiet)
 {
 	if (!m_valid)
@@ -291,6 +330,11 @@ UWLExitCode UberWolfLib::DecryptWolfXFiles()
 	return UWLExitCode::SUCCESS;
 }
 
+void UberWolfLib::SetEntryFilters(const tStrings& include, const tStrings& exclude)
+{
+	m_wolfDec.SetEntryFilters(include, exclude);
+}
+
 void UberWolfLib::ResetWolfDec()
 {
 	m_wolfDec.Reset();
@@ -345,6 +389,117 @@ UWLExitCode UberWolfLib::packData(const tString& dataPath)
 	return result ? UWLExitCode::SUCCESS : UWLExitCode::UNKNOWN_ERROR;
 }
 
+// Unpack archives with the mode WolfDec already has on several threads, the log of each archive is written in order once it is done
+UWLExitCode UberWolfLib::unpackParallel(const tStrings& archives)
+{
+	const std::size_t hwThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	const std::size_t jobs      = std::min<std::size_t>(m_config.jobs == 0 ? hwThreads : m_config.jobs, archives.size());
+	const std::size_t budget    = (m_config.threads == 0 ? hwThreads : m_config.threads);
+
+	std::vector<uberLog::Capture> logs(archives.size());
+	std::vector<uint8_t> results(archives.size(), 0);
+	std::vector<uint8_t> done(archives.size(), 0);
+	std::atomic<std::size_t> next = 0;
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::vector<std::thread> threads;
+
+	// Every job decodes with its own threads, split the thread budget between the jobs instead of starting it once per job
+	m_wolfDec.SetDecodeThreadNum(static_cast<uint32_t>(std::max<std::size_t>(budget / jobs, 1)));
+
+	for (std::size_t i = 0; i < jobs; i++)
+	{
+		threads.emplace_back([&]() {
+			for (std::size_t idx = next++; idx < archives.size(); idx = next++)
+			{
+				UberLog::BeginCapture(&logs[idx]);
+				const bool result = tryUnpackArchive(archives[idx]);
+				UberLog::EndCapture();
+
+				std::lock_guard<std::mutex> lock(mutex);
+				results[idx] = result;
+				done[idx]    = 1;
+				cv.notify_all();
+			}
+		});
+	}
+
+	UWLExitCode uec = UWLExitCode::SUCCESS;
+	bool joined     = false;
+
+	for (std::size_t idx = 0; idx < archives.size() && uec == UWLExitCode::SUCCESS; idx++)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			cv.wait(lock, [&]() { return done[idx] != 0; });
+		}
+
+		if (results[idx])
+		{
+			UberLog::Replay(logs[idx]);
+			continue;
+		}
+
+		// Recovering from a failure can search the key and change the mode, so it only runs once no other archive is being unpacked
+		if (!joined)
+		{
+			for (std::thread& thread : threads)
+				thread.join();
+
+			m_wolfDec.SetDecodeThreadNum(static_cast<uint32_t>(m_config.threads));
+			joined = true;
+		}
+
+		uec = unpackArchive(archives[idx]);
+	}
+
+	if (!joined)
+	{
+		for (std::thread& thread : threads)
+			thread.join();
+
+		m_wolfDec.SetDecodeThreadNum(static_cast<uint32_t>(m_config.threads));
+	}
+
+	return uec;
+}
+
+// Unpack an archive without searching keys or the game on failure, so it can run next to other archives.
+// Runs on a worker thread, so nothing may escape from it, a failed archive is retried in order afterwards
+bool UberWolfLib::tryUnpackArchive(const tString& archivePath)
+{
+	try
+	{
+		if (!fs::exists(archivePath) || !m_wolfDec)
+			return false;
+
+		const tString fileName = fs::path(archivePath).filename();
+
+		if (!m_wolfDec.IsValidFile(archivePath))
+			return true;
+
+		if (!m_config.override && m_wolfDec.IsAlreadyUnpacked(archivePath))
+		{
+			INFO_LOG << vFormat(LOCALIZE("unpacked_msg"), fileName) << std::endl;
+			return true;
+		}
+
+		INFO_LOG << vFormat(LOCALIZE("unpacking_msg"), fileName);
+
+		if (!m_wolfDec.UnpackArchive(archivePath, m_config.override))
+			return false;
+
+		INFO_LOG << LOCALIZE("done_msg") << std::endl;
+
+		return true;
+	}
+	catch (const std::exception& e)
+	{
+		ERROR_LOG << std::format(TEXT("Unpacking {} failed: {}"), fs::path(archivePath).filename().native(), StringToWString(e.what())) << std::endl;
+		return false;
+	}
+}
+
 UWLExitCode UberWolfLib::unpackArchive(const tString& archivePath, const bool& quiet, const bool& secondRun)
 {
 	// Make sure the file exists
@@ -51,9 +51,11 @@ class UberWolfLib
 {
 	struct Config
 	{
-		bool override  = false;
-		bool unprotect = false;
-		bool decWolfX  = false;
+		bool override    = false;
+		bool unprotect   = false;
+		bool decWolfX    = false;
+		std::size_t jobs    = 1;
+		std::size_t threads = 0;
 	};
 
 public:
@@ -82,12 +84,31 @@ public:
 	UWLExitCode UnpackDataVec(const tStrings& paths);
 	UWLExitCode UnpackArchive(const tString& archivePath);
 
+	UWLExitCode ListArchive(const tString& archivePath, ArchiveEntries& entries);
+
 	UWLExitCode FindDxArcKey(const bool& quiet = false);
 	UWLExitCode FindProtectionKey(std::string& key);
 	UWLExitCode FindProtectionKey(std::wstring& key);
 
 	UWLExitCode DecryptWolfXFiles();
 
+	// Glob patterns selecting the archive entries to extract, '*' stays inside a directory, '**' does not
+	// Patterns without a directory separator match any path component, e.g., "BasicData" or "*.mps"
+	void SetEntryFilters(const tStrings& include, const tStrings& exclude = {});
+
+	// Number of archives UnpackDataVec extracts at once after the first archive decided the mode ( 0: one per hardware thread )
+	void SetJobCount(const std::size_t& jobs)
+	{
+		m_config.jobs = jobs;
+	}
+
+	// Number of threads extracting the entries of a single archive ( 0: one per hardware thread )
+	void SetThreadCount(const std::size_t& threads)
+	{
+		m_config.threads = threads;
+		m_wolfDec.SetDecodeThreadNum(static_cast<uint32_t>(threads));
+	}
+
 	void ResetWolfDec();
 
 	static std::size_t RegisterLogCallback(const LogCallback& callback);
@@ -109,6 +130,8 @@ public:
 private:
 	UWLExitCode packData(const tString& dataPath);
 	UWLExitCode unpackArchive(const tString& archivePath, const bool& quiet = false, const bool& secondRun = false);
+	UWLExitCode unpackParallel(const tStrings& archives);
+	bool tryUnpackArchive(const tString& archivePath);
 	bool findDataFolder();
 	UWLExitCode findDxArcKeyFile(const bool& quiet = false);
 	void updateConfig(const bool& useOldDxArc, const Key& key);
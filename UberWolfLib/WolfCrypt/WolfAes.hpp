@@ -26,10 +26,13 @@
 
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <bit>
 #include <cstdint>
+#include <cstring>
 
+#include "WolfCryptSimd.hpp"
 #include "WolfCryptUtils.hpp"
 
 namespace wolf::crypt::aes
@@ -256,37 +259,178 @@ inline void cipher(uint8_t *pState, const uint8_t *pRoundKey)
 	addRoundKey(pState, Nr, pRoundKey);
 }
 
-// AES_CTR_xcrypt
-inline void aesCtrXCrypt(uint8_t *pData, uint8_t *pKey, const std::size_t &size)
+// --- Keystream kernels ---
+// Only the key expansion differs from standard AES, so the round keys it creates can be used
+// with the standard round function of AES-NI and the T-tables
+
+// Number of blocks computed per kernel call
+inline constexpr uint32_t KEYSTREAM_BLOCKS = 32;
+
+// Add n to the big endian counter
+inline void addCounter(uint8_t *pCounter, uint64_t n)
+{
+	for (int32_t i = BLOCKLEN - 1; i >= 0 && n != 0; i--)
+	{
+		n += pCounter[i];
+		pCounter[i] = static_cast<uint8_t>(n & 0xFF);
+		n >>= 8;
+	}
+}
+
+// Combined SubBytes and MixColumns for the first row of a column, the other rows are rotations of it
+inline constexpr std::array<uint32_t, 256> Te0 = []() {
+	std::array<uint32_t, 256> table = {};
+
+	for (uint32_t i = 0; i < 256; i++)
+	{
+		const uint32_t s  = sbox[i];
+		const uint32_t s2 = ((s << 1) ^ (((s >> 7) & 1) * 0x1b)) & 0xFF;
+
+		table[i] = s2 | (s << 8) | (s << 16) | ((s2 ^ s) << 24);
+	}
+
+	return table;
+}();
+
+inline uint32_t load32(const uint8_t *pData)
+{
+	uint32_t value;
+	std::memcpy(&value, pData, sizeof(value));
+	return value;
+}
+
+// Encrypt one block with the T-tables, the columns are little endian words
+inline void cipherTTable(const uint8_t *pIn, uint8_t *pOut, const uint8_t *pRoundKey)
 {
-	uint8_t state[BLOCKLEN];
-	uint8_t *pIv = pKey + KEY_EXP_SIZE;
-	int32_t bi   = BLOCKLEN;
+	uint32_t s[4];
+	uint32_t t[4];
 
-	for (std::size_t i = 0; i < size; i++, bi++)
+	for (uint32_t c = 0; c < 4; c++)
+		s[c] = load32(pIn + c * 4) ^ load32(pRoundKey + c * 4);
+
+	for (uint32_t round = 1; round < Nr; round++)
+	{
+		for (uint32_t c = 0; c < 4; c++)
+			t[c] = Te0[s[c] & 0xFF] ^ std::rotl(Te0[(s[(c + 1) % 4] >> 8) & 0xFF], 8) ^ std::rotl(Te0[(s[(c + 2) % 4] >> 16) & 0xFF], 16) ^ std::rotl(Te0[s[(c + 3) % 4] >> 24], 24) ^ load32(pRoundKey + (round * KEY_SIZE) + c * 4);
+
+		std::memcpy(s, t, sizeof(s));
+	}
+
+	// The last round has no MixColumns
+	for (uint32_t c = 0; c < 4; c++)
+	{
+		t[c] = static_cast<uint32_t>(sbox[s[c] & 0xFF]) | (static_cast<uint32_t>(sbox[(s[(c + 1) % 4] >> 8) & 0xFF]) << 8) | (static_cast<uint32_t>(sbox[(s[(c + 2) % 4] >> 16) & 0xFF]) << 16) | (static_cast<uint32_t>(sbox[s[(c + 3) % 4] >> 24]) << 24);
+		t[c] ^= load32(pRoundKey + (Nr * KEY_SIZE) + c * 4);
+	}
+
+	std::memcpy(pOut, t, BLOCKLEN);
+}
+
+inline void keyStreamTTable(const uint8_t *pRoundKey, const uint8_t *pCounter, uint8_t *pKeyStream, const uint32_t &blockCount)
+{
+	uint8_t counter[BLOCKLEN];
+	std::memcpy(counter, pCounter, BLOCKLEN);
+
+	for (uint32_t i = 0; i < blockCount; i++)
 	{
-		if (bi == BLOCKLEN)
+		cipherTTable(counter, pKeyStream + i * BLOCKLEN, pRoundKey);
+		addCounter(counter, 1);
+	}
+}
+
+#ifdef SIMD_MSVC_X86
+inline void keyStreamAESNI(const uint8_t *pRoundKey, const uint8_t *pCounter, uint8_t *pKeyStream, const uint32_t &blockCount)
+{
+	// Number of independent blocks in flight, hides the latency of aesenc
+	constexpr uint32_t PIPELINE = 8;
+
+	__m128i roundKeys[Nr + 1];
+	__m128i blocks[PIPELINE];
+	uint8_t counter[BLOCKLEN];
+
+	for (uint32_t r = 0; r <= Nr; r++)
+		roundKeys[r] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pRoundKey + r * KEY_SIZE));
+
+	std::memcpy(counter, pCounter, BLOCKLEN);
+
+	for (uint32_t i = 0; i < blockCount; i += PIPELINE)
+	{
+		const uint32_t count = std::min(PIPELINE, blockCount - i);
+
+		for (uint32_t j = 0; j < count; j++)
 		{
-			std::memcpy(state, pIv, BLOCKLEN);
-
-			cipher(state, pKey);
-
-			for (bi = BLOCKLEN - 1; bi >= 0; bi--)
-			{
-				if (pIv[bi] == 0xFF)
-				{
-					pIv[bi] = 0;
-					continue;
-				}
-				pIv[bi]++;
-				break;
-			}
-			bi = 0;
+			blocks[j] = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(counter)), roundKeys[0]);
+			addCounter(counter, 1);
 		}
 
-		pData[i] ^= state[bi];
+		for (uint32_t r = 1; r < Nr; r++)
+		{
+			for (uint32_t j = 0; j < count; j++)
+				blocks[j] = _mm_aesenc_si128(blocks[j], roundKeys[r]);
+		}
+
+		for (uint32_t j = 0; j < count; j++)
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(pKeyStream + (i + j) * BLOCKLEN), _mm_aesenclast_si128(blocks[j], roundKeys[Nr]));
 	}
 }
+#endif
+
+// --- Dispatcher ---
+
+using KeyStreamFunction = void (*)(const uint8_t *, const uint8_t *, uint8_t *, const uint32_t &);
+
+inline KeyStreamFunction selectKeyStreamFunc([[maybe_unused]] const simd::CpuFeatures &features)
+{
+#ifdef SIMD_MSVC_X86
+	if (features.aes)
+		return keyStreamAESNI;
+#endif
+
+	return keyStreamTTable;
+}
+
+// XOR the key stream starting at offset inside the block of pCounter, the counter is advanced past every started block
+inline void ctrXorKeyStream(uint8_t *pData, const uint8_t *pRoundKey, uint8_t *pCounter, const std::size_t &size, uint32_t offset)
+{
+	const KeyStreamFunction keyStreamFunc = detail::selectOnce<selectKeyStreamFunc>();
+
+	uint8_t keyStream[KEYSTREAM_BLOCKS * BLOCKLEN];
+	std::size_t position = 0;
+
+	while (position < size)
+	{
+		const uint32_t blockCount = static_cast<uint32_t>(std::min<std::size_t>(KEYSTREAM_BLOCKS, (offset + (size - position) + BLOCKLEN - 1) / BLOCKLEN));
+		const std::size_t steps   = std::min<std::size_t>(blockCount * BLOCKLEN - offset, size - position);
+
+		keyStreamFunc(pRoundKey, pCounter, keyStream, blockCount);
+		addCounter(pCounter, blockCount);
+
+		detail::xorKey(pData + position, keyStream + offset, 0, steps);
+
+		position += steps;
+		offset = 0;
+	}
+}
+
+// AES_CTR_xcrypt
+inline void aesCtrXCrypt(uint8_t *pData, uint8_t *pKey, const std::size_t &size)
+{
+	ctrXorKeyStream(pData, pKey, pKey + KEY_EXP_SIZE, size, 0);
+}
+
+// AES_CTR_xcrypt starting at byte offset of the key stream, the IV inside pKey is not modified
+// so any part of the data can be processed on its own and in any order
+inline void aesCtrXCryptAt(uint8_t *pData, const uint8_t *pKey, const std::size_t &size, const uint64_t &offset)
+{
+	uint8_t iv[BLOCKLEN];
+
+	std::memcpy(iv, pKey + KEY_EXP_SIZE, BLOCKLEN);
+
+	// Advance the big endian counter to the block containing offset
+	addCounter(iv, offset / BLOCKLEN);
+
+	ctrXorKeyStream(pData, pKey, iv, size, static_cast<uint32_t>(offset % BLOCKLEN));
+}
 
 ////// AES CTR Crypt
 /////////////////////////////////
@@ -26,8 +26,12 @@
 
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <cstdint>
+#include <cstring>
+
+#include "WolfCryptSimd.hpp"
 
 namespace wolf::crypt::chacha20
 {
@@ -140,6 +144,237 @@ inline void execute(uint32_t *pState, uint32_t *pKeyStream, const uint32_t &star
 	}
 }
 
+// --- Multi-block keystream ---
+// The blocks of the keystream only differ in the counter, so several blocks are computed at once,
+// one block per SIMD lane with the state words spread over the vectors
+
+// Number of bytes in one keystream block
+static constexpr uint32_t BLOCK_SIZE = 64;
+
+// Compute one block for the counter in pState[12]
+inline void blocksPlain(const uint32_t *pState, uint8_t *pKeyStream)
+{
+	uint32_t state[16];
+	uint32_t keyStream[16];
+
+	std::memcpy(state, pState, sizeof(state));
+	blockNext(state, keyStream);
+	std::memcpy(pKeyStream, keyStream, BLOCK_SIZE);
+}
+
+#ifdef SIMD_MSVC_X86
+#define CHACHA20_ROTL_SSE2(x, n) _mm_or_si128(_mm_slli_epi32(x, n), _mm_srli_epi32(x, 32 - n))
+
+#define CHACHA20_QUARTERROUND_SSE2(x, a, b, c, d)                  \
+	x[a] = _mm_add_epi32(x[a], x[b]);                              \
+	x[d] = CHACHA20_ROTL_SSE2(_mm_xor_si128(x[d], x[a]), 16);      \
+	x[c] = _mm_add_epi32(x[c], x[d]);                              \
+	x[b] = CHACHA20_ROTL_SSE2(_mm_xor_si128(x[b], x[c]), 12);      \
+	x[a] = _mm_add_epi32(x[a], x[b]);                              \
+	x[d] = CHACHA20_ROTL_SSE2(_mm_xor_si128(x[d], x[a]), 8);       \
+	x[c] = _mm_add_epi32(x[c], x[d]);                              \
+	x[b] = CHACHA20_ROTL_SSE2(_mm_xor_si128(x[b], x[c]), 7);
+
+// Compute the 4 blocks following the counter in pState[12]
+inline void blocksSSE2(const uint32_t *pState, uint8_t *pKeyStream)
+{
+	__m128i state[16];
+	__m128i x[16];
+
+	for (uint32_t i = 0; i < 16; i++)
+		state[i] = _mm_set1_epi32(static_cast<int>(pState[i]));
+
+	state[12] = _mm_add_epi32(state[12], _mm_setr_epi32(0, 1, 2, 3));
+
+	for (uint32_t i = 0; i < 16; i++)
+		x[i] = state[i];
+
+	for (uint32_t i = 0; i < 10; i++)
+	{
+		CHACHA20_QUARTERROUND_SSE2(x, 0, 4, 8, 12)
+		CHACHA20_QUARTERROUND_SSE2(x, 1, 5, 9, 13)
+		CHACHA20_QUARTERROUND_SSE2(x, 2, 6, 10, 14)
+		CHACHA20_QUARTERROUND_SSE2(x, 3, 7, 11, 15)
+		CHACHA20_QUARTERROUND_SSE2(x, 0, 5, 10, 15)
+		CHACHA20_QUARTERROUND_SSE2(x, 1, 6, 11, 12)
+		CHACHA20_QUARTERROUND_SSE2(x, 2, 7, 8, 13)
+		CHACHA20_QUARTERROUND_SSE2(x, 3, 4, 9, 14)
+	}
+
+	for (uint32_t i = 0; i < 16; i++)
+		x[i] = _mm_add_epi32(x[i], state[i]);
+
+	// Transpose each group of 4 words, so every block is stored contiguously
+	for (uint32_t i = 0; i < 16; i += 4)
+	{
+		const __m128i t0 = _mm_unpacklo_epi32(x[i + 0], x[i + 1]);
+		const __m128i t1 = _mm_unpacklo_epi32(x[i + 2], x[i + 3]);
+		const __m128i t2 = _mm_unpackhi_epi32(x[i + 0], x[i + 1]);
+		const __m128i t3 = _mm_unpackhi_epi32(x[i + 2], x[i + 3]);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(pKeyStream + 0 * BLOCK_SIZE + i * 4), _mm_unpacklo_epi64(t0, t1));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(pKeyStream + 1 * BLOCK_SIZE + i * 4), _mm_unpackhi_epi64(t0, t1));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(pKeyStream + 2 * BLOCK_SIZE + i * 4), _mm_unpacklo_epi64(t2, t3));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(pKeyStream + 3 * BLOCK_SIZE + i * 4), _mm_unpackhi_epi64(t2, t3));
+	}
+}
+
+#define CHACHA20_ROTL_AVX2(x, n) _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - n))
+
+#define CHACHA20_QUARTERROUND_AVX2(x, a, b, c, d)                     \
+	x[a] = _mm256_add_epi32(x[a], x[b]);                              \
+	x[d] = CHACHA20_ROTL_AVX2(_mm256_xor_si256(x[d], x[a]), 16);      \
+	x[c] = _mm256_add_epi32(x[c], x[d]);                              \
+	x[b] = CHACHA20_ROTL_AVX2(_mm256_xor_si256(x[b], x[c]), 12);      \
+	x[a] = _mm256_add_epi32(x[a], x[b]);                              \
+	x[d] = CHACHA20_ROTL_AVX2(_mm256_xor_si256(x[d], x[a]), 8);       \
+	x[c] = _mm256_add_epi32(x[c], x[d]);                              \
+	x[b] = CHACHA20_ROTL_AVX2(_mm256_xor_si256(x[b], x[c]), 7);
+
+// Compute the 8 blocks following the counter in pState[12]
+inline void blocksAVX2(const uint32_t *pState, uint8_t *pKeyStream)
+{
+	__m256i state[16];
+	__m256i x[16];
+
+	for (uint32_t i = 0; i < 16; i++)
+		state[i] = _mm256_set1_epi32(static_cast<int>(pState[i]));
+
+	// Blocks 0-3 are in the lower 128 bit lane and blocks 4-7 in the upper one, matching the transpose below
+	state[12] = _mm256_add_epi32(state[12], _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+
+	for (uint32_t i = 0; i < 16; i++)
+		x[i] = state[i];
+
+	for (uint32_t i = 0; i < 10; i++)
+	{
+		CHACHA20_QUARTERROUND_AVX2(x, 0, 4, 8, 12)
+		CHACHA20_QUARTERROUND_AVX2(x, 1, 5, 9, 13)
+		CHACHA20_QUARTERROUND_AVX2(x, 2, 6, 10, 14)
+		CHACHA20_QUARTERROUND_AVX2(x, 3, 7, 11, 15)
+		CHACHA20_QUARTERROUND_AVX2(x, 0, 5, 10, 15)
+		CHACHA20_QUARTERROUND_AVX2(x, 1, 6, 11, 12)
+		CHACHA20_QUARTERROUND_AVX2(x, 2, 7, 8, 13)
+		CHACHA20_QUARTERROUND_AVX2(x, 3, 4, 9, 14)
+	}
+
+	for (uint32_t i = 0; i < 16; i++)
+		x[i] = _mm256_add_epi32(x[i], state[i]);
+
+	// The unpacks work within the 128 bit lanes, so each group of 4 words is transposed for blocks 0-3 and 4-7 at once
+	for (uint32_t i = 0; i < 16; i += 4)
+	{
+		const __m256i t0 = _mm256_unpacklo_epi32(x[i + 0], x[i + 1]);
+		const __m256i t1 = _mm256_unpacklo_epi32(x[i + 2], x[i + 3]);
+		const __m256i t2 = _mm256_unpackhi_epi32(x[i + 0], x[i + 1]);
+		const __m256i t3 = _mm256_unpackhi_epi32(x[i + 2], x[i + 3]);
+
+		const __m256i rows[4] = { _mm256_unpacklo_epi64(t0, t1), _mm256_unpackhi_epi64(t0, t1), _mm256_unpacklo_epi64(t2, t3), _mm256_unpackhi_epi64(t2, t3) };
+
+		for (uint32_t b = 0; b < 4; b++)
+		{
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(pKeyStream + b * BLOCK_SIZE + i * 4), _mm256_castsi256_si128(rows[b]));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(pKeyStream + (b + 4) * BLOCK_SIZE + i * 4), _mm256_extracti128_si256(rows[b], 1));
+		}
+	}
+}
+
+#undef CHACHA20_QUARTERROUND_AVX2
+#undef CHACHA20_ROTL_AVX2
+#undef CHACHA20_QUARTERROUND_SSE2
+#undef CHACHA20_ROTL_SSE2
+#endif
+
+// --- Dispatcher ---
+
+using BlocksFunction = void (*)(const uint32_t *, uint8_t *);
+
+struct BlocksKernel
+{
+	BlocksFunction func;
+	uint32_t blockCount; // Number of blocks computed per call
+};
+
+inline BlocksKernel selectBlocksKernel([[maybe_unused]] const simd::CpuFeatures &features)
+{
+#ifdef SIMD_MSVC_X86
+	if (features.avx2)
+		return { blocksAVX2, 8 };
+	else if (features.sse2)
+		return { blocksSSE2, 4 };
+#endif
+
+	return { blocksPlain, 1 };
+}
+
+// Keystream block a thread used last, a chunked read continues in the block the previous chunk ended in
+struct BlockCache
+{
+	uint32_t state[16]; // State including the counter of the block
+	uint8_t keyStream[BLOCK_SIZE];
+	bool valid = false;
+};
+
+inline const uint8_t *cachedBlock(const uint32_t *pState)
+{
+	// Thread local, so archives can be decoded on multiple threads at once
+	static thread_local BlockCache cache;
+
+	if (!cache.valid || std::memcmp(cache.state, pState, sizeof(cache.state)) != 0)
+	{
+		std::memcpy(cache.state, pState, sizeof(cache.state));
+		blocksPlain(pState, cache.keyStream);
+		cache.valid = true;
+	}
+
+	return cache.keyStream;
+}
+
+// Same result as initBlock followed by execute, but the full blocks are computed several at once
+// and partial blocks at the start and end are cached for the next call
+inline void xorKeyStream(const uint8_t *pKey, const uint8_t *pNonce, const uint32_t &startPos, uint8_t *bytes, const uint64_t &length)
+{
+	const BlocksKernel kernel = detail::selectOnce<selectBlocksKernel>();
+
+	uint32_t state[16];
+	uint8_t keyStream[8 * BLOCK_SIZE];
+	uint64_t position = 0;
+	uint32_t offset   = startPos % BLOCK_SIZE;
+
+	initBlock(state, pKey, pNonce);
+	state[12] += startPos / BLOCK_SIZE;
+
+	while (position < length)
+	{
+		const uint64_t remaining = length - position;
+
+		// Partial blocks, usually the block shared with the previous or next chunk of a read
+		if (offset != 0 || remaining < BLOCK_SIZE)
+		{
+			const uint32_t steps = static_cast<uint32_t>(std::min<uint64_t>(BLOCK_SIZE - offset, remaining));
+
+			detail::xorKey(bytes + position, cachedBlock(state) + offset, 0, steps);
+
+			position += steps;
+			offset = 0;
+			state[12]++;
+			continue;
+		}
+
+		const uint32_t blockCount = static_cast<uint32_t>(std::min<uint64_t>(kernel.blockCount, remaining / BLOCK_SIZE));
+
+		if (blockCount == 1)
+			blocksPlain(state, keyStream);
+		else
+			kernel.func(state, keyStream);
+
+		detail::xorKey(bytes + position, keyStream, 0, blockCount * BLOCK_SIZE);
+
+		position += blockCount * BLOCK_SIZE;
+		state[12] += blockCount;
+	}
+}
+
 inline void keySetup(const std::array<uint8_t, 4> &data, std::array<uint8_t, 64> &key)
 {
 	static constexpr uint8_t mod1[4] = { 0x3F, 0xA7, 0xD2, 0x1C };
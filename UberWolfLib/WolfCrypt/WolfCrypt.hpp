@@ -26,6 +26,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <cstdint>
 #include <numeric>
@@ -35,6 +36,7 @@
 
 #include "WolfAes.hpp"
 #include "WolfChaCha20.hpp"
+#include "WolfCryptSimd.hpp"
 #include "WolfCryptTypes.hpp"
 #include "WolfRng.hpp"
 
@@ -52,15 +54,22 @@ inline void wolfCrypt(const uint8_t *pKey, uint8_t *pData, const int64_t &start,
 	uint32_t v2Cnt = start / 256 % 256;
 	int32_t v3Cnt  = start / 0x10000 % 256;
 
+	// Within a run of 256 bytes the keystream is the first key row combined with one constant byte
+	// from the other rows, so whole runs are XORed at once
 	if (utils::isV35(cryptVersion))
 	{
 		uint8_t moddedKey[512];
 		for (uint32_t i = 0; i < 512; i++)
 			moddedKey[i] = pKey[i % 256] ^ (7 * i);
 
-		for (uint64_t i = 0; i < length; i++)
+		for (uint64_t i = 0; i < length;)
 		{
-			pData[i] ^= moddedKey[v1Cnt++] ^ moddedKey[v2Cnt + 256];
+			const uint32_t runSize = static_cast<uint32_t>(std::min<uint64_t>(256 - v1Cnt, length - i));
+
+			detail::xorKey(pData + i, moddedKey + v1Cnt, moddedKey[v2Cnt + 256], runSize);
+
+			i += runSize;
+			v1Cnt += runSize;
 
 			if (v1Cnt == 256)
 			{
@@ -71,9 +80,14 @@ inline void wolfCrypt(const uint8_t *pKey, uint8_t *pData, const int64_t &start,
 	}
 	else
 	{
-		for (uint64_t i = 0; i < length; i++)
+		for (uint64_t i = 0; i < length;)
 		{
-			pData[i] ^= pKey[v1Cnt++] ^ pKey[v2Cnt + 256] ^ pKey[v3Cnt + 512];
+			const uint32_t runSize = static_cast<uint32_t>(std::min<uint64_t>(256 - v1Cnt, length - i));
+
+			detail::xorKey(pData + i, pKey + v1Cnt, pKey[v2Cnt + 256] ^ pKey[v3Cnt + 512], runSize);
+
+			i += runSize;
+			v1Cnt += runSize;
 
 			if (v1Cnt == 256)
 			{
@@ -103,7 +117,8 @@ inline void calcSalt(const char *pStr, uint8_t *pSalt)
 
 inline uint32_t xorshift32(const uint32_t &seed = 0)
 {
-	static uint32_t state = 0;
+	// Thread local, so archives can be decoded on multiple threads at once
+	static thread_local uint32_t state = 0;
 
 	if (seed != 0)
 		state = seed;
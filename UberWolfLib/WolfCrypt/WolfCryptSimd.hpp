@@ -0,0 +1,174 @@
+/*
+ *  File: WolfCryptSimd.hpp
+ *  Copyright (c) 2025 Sinflower
+ *
+ *  MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "../WolfX/SimdFeatures.hpp"
+
+#ifdef SIMD_MSVC_X86
+#include <immintrin.h>
+#endif
+
+namespace wolf::crypt::detail
+{
+// --- SIMD Implementations ---
+
+// pData[i] ^= pKey[i] ^ keyConst for i < size, the keystream of the crypt layers is a key row combined with one constant byte
+
+inline void xorKeyPlain(uint8_t *pData, const uint8_t *pKey, const uint8_t &keyConst, const std::size_t &size)
+{
+	const uint64_t keyConst64 = 0x0101010101010101ULL * keyConst;
+
+	std::size_t i = 0;
+
+	for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+	{
+		uint64_t data, key;
+		std::memcpy(&data, pData + i, sizeof(uint64_t));
+		std::memcpy(&key, pKey + i, sizeof(uint64_t));
+		data ^= key ^ keyConst64;
+		std::memcpy(pData + i, &data, sizeof(uint64_t));
+	}
+
+	for (; i < size; i++)
+		pData[i] ^= pKey[i] ^ keyConst;
+}
+
+#ifdef SIMD_MSVC_X86
+inline void xorKeySSE2(uint8_t *pData, const uint8_t *pKey, const uint8_t &keyConst, const std::size_t &size)
+{
+	constexpr std::size_t simd_width = 16;
+
+	const __m128i keyConst128 = _mm_set1_epi8(static_cast<char>(keyConst));
+
+	std::size_t i = 0;
+
+	// Neither the data nor the key row have a fixed alignment, the runs start at any archive position
+	for (; i + simd_width <= size; i += simd_width)
+	{
+		__m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pData + i));
+		__m128i key  = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pKey + i));
+		data         = _mm_xor_si128(data, _mm_xor_si128(key, keyConst128));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(pData + i), data);
+	}
+
+	// Fallback for remaining bytes
+	for (; i < size; i++)
+		pData[i] ^= pKey[i] ^ keyConst;
+}
+
+inline void xorKeyAVX2(uint8_t *pData, const uint8_t *pKey, const uint8_t &keyConst, const std::size_t &size)
+{
+	constexpr std::size_t simd_width = 32;
+
+	const __m256i keyConst256 = _mm256_set1_epi8(static_cast<char>(keyConst));
+
+	std::size_t i = 0;
+
+	for (; i + simd_width <= size; i += simd_width)
+	{
+		__m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pData + i));
+		__m256i key  = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pKey + i));
+		data         = _mm256_xor_si256(data, _mm256_xor_si256(key, keyConst256));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(pData + i), data);
+	}
+
+	// The SSE2 kernel handles the last 16 byte block and the remaining bytes
+	xorKeySSE2(pData + i, pKey + i, keyConst, size - i);
+}
+#endif
+
+// --- Dispatcher ---
+
+// Kernel Select picks for the CPU, the features are checked on the first call only.
+// The archives are decoded on several threads, the thread safe initialization of the static gives all of them the same kernel
+template<auto Select>
+inline auto selectOnce()
+{
+	static const auto kernel = Select(simd::detectCpuFeatures());
+
+	return kernel;
+}
+
+using XorKeyFunction = void (*)(uint8_t *, const uint8_t *, const uint8_t &, const std::size_t &);
+
+inline XorKeyFunction selectXorKeyFunc([[maybe_unused]] const simd::CpuFeatures &features)
+{
+#ifdef SIMD_MSVC_X86
+	if (features.avx2)
+		return xorKeyAVX2;
+	else if (features.sse2)
+		return xorKeySSE2;
+#endif
+
+	return xorKeyPlain;
+}
+
+inline void xorKey(uint8_t *pData, const uint8_t *pKey, const uint8_t &keyConst, const std::size_t &size)
+{
+	const XorKeyFunction xorKeyFunc = selectOnce<selectXorKeyFunc>();
+
+	xorKeyFunc(pData, pKey, keyConst, size);
+}
+
+// pData[i] ^= pKey[(keyPos + i) % keySize] for i < size, the XOR layer of the DX archives with their short key
+inline void xorRepeatingKey(uint8_t *pData, const uint8_t *pKey, const uint32_t &keySize, const uint32_t &keyPos, const std::size_t &size)
+{
+	// Longest run that is a multiple of the key size, so every run starts at the same key position
+	constexpr uint32_t MAX_RUN = 256;
+
+	// An empty key leaves the data as is
+	if (keySize == 0) return;
+
+	// Keys longer than a run are XORed byte by byte
+	if (keySize > MAX_RUN)
+	{
+		for (std::size_t i = 0; i < size; i++)
+			pData[i] ^= pKey[(keyPos + i) % keySize];
+
+		return;
+	}
+
+	const uint32_t runSize = MAX_RUN / keySize * keySize;
+	const uint32_t phase   = keyPos % keySize;
+
+	// The key repeated so that a run starting at any key position can be read in one piece
+	uint8_t pattern[MAX_RUN * 2];
+	for (uint32_t i = 0; i < phase + runSize; i++)
+		pattern[i] = pKey[i % keySize];
+
+	std::size_t i = 0;
+
+	for (; i + runSize <= size; i += runSize)
+		xorKey(pData + i, pattern + phase, 0, runSize);
+
+	xorKey(pData + i, pattern + phase, 0, size - i);
+}
+
+} // namespace wolf::crypt::detail
@@ -48,12 +48,7 @@ inline void decryptData(std::vector<uint8_t> &data, const SeedIncides &seeds)
 {
 	static constexpr std::size_t DECRYPT_INTERVALS[] = { 1, 2, 5 };
 	for (std::size_t i = 0; i < seeds.size(); i++)
-	{
-		rng::msvc_srand(seeds[i]);
-
-		for (std::size_t j = 0; j < data.size(); j += DECRYPT_INTERVALS[i])
-			data[j] ^= static_cast<uint8_t>(rng::msvc_rand() >> 12);
-	}
+		rng::msvcRandXor(data.data(), data.size(), seeds[i], 12, DECRYPT_INTERVALS[i]);
 }
 } // namespace v2_0
 
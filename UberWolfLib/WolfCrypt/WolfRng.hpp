@@ -26,9 +26,12 @@
 
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <cstdint>
 
+#include "WolfCryptSimd.hpp"
+
 namespace wolf::crypt::rng
 {
 #ifdef _WIN32
@@ -42,7 +45,8 @@ inline int msvc_rand(void)
 	return rand();
 }
 #else
-static unsigned long s_winRngSeed = 1;
+// Thread local to match the per-thread rand() state of the MSVC CRT
+static thread_local unsigned long s_winRngSeed = 1;
 
 inline void msvc_srand(unsigned int seed)
 {
@@ -56,6 +60,155 @@ inline int msvc_rand(void)
 }
 #endif
 
+// --- MSVC rand() keystream ---
+// rand() of the MSVC CRT is the LCG state = state * 214013 + 2531011 with (state >> 16) & 0x7FFF as result.
+// n steps of an LCG are again an LCG, so the stream can be jumped ahead and split into interleaved lanes
+
+inline constexpr uint32_t MSVC_RAND_MUL = 214013;
+inline constexpr uint32_t MSVC_RAND_INC = 2531011;
+
+// state * mul + inc is the state after the number of steps the jump was created for
+struct LcgJump
+{
+	uint32_t mul;
+	uint32_t inc;
+
+	uint32_t apply(const uint32_t &state) const
+	{
+		return state * mul + inc;
+	}
+};
+
+inline constexpr LcgJump msvcRandJump(uint64_t steps)
+{
+	LcgJump jump     = { 1, 0 };
+	uint32_t stepMul = MSVC_RAND_MUL;
+	uint32_t stepInc = MSVC_RAND_INC;
+
+	// Combine the jumps of 1, 2, 4, ... steps selected by the bits of steps
+	while (steps != 0)
+	{
+		if (steps & 1)
+		{
+			jump.mul = jump.mul * stepMul;
+			jump.inc = jump.inc * stepMul + stepInc;
+		}
+
+		stepInc = (stepMul + 1) * stepInc;
+		stepMul = stepMul * stepMul;
+		steps >>= 1;
+	}
+
+	return jump;
+}
+
+// Write the low bytes of count successive msvc_rand() >> shift results to pOut, state is advanced by count steps
+inline void msvcRandBytesPlain(uint32_t &state, uint8_t *pOut, const std::size_t &count, const uint32_t &shift)
+{
+	for (std::size_t i = 0; i < count; i++)
+	{
+		state   = state * MSVC_RAND_MUL + MSVC_RAND_INC;
+		pOut[i] = static_cast<uint8_t>(((state >> 16) & 0x7FFF) >> shift);
+	}
+}
+
+#ifdef SIMD_MSVC_X86
+inline void msvcRandBytesAVX2(uint32_t &state, uint8_t *pOut, const std::size_t &count, const uint32_t &shift)
+{
+	constexpr std::size_t LANES      = 8;
+	constexpr std::size_t simd_width = 4 * LANES; // Four state vectors are packed into one store
+
+	const std::size_t simdCount = count / simd_width * simd_width;
+
+	if (simdCount != 0)
+	{
+		// Vector v holds steps 8 * v + 1 to 8 * v + 8 in its lanes and advances them by 32 steps,
+		// so the four multiplications of an iteration do not wait for each other
+		uint32_t lanes[simd_width];
+		uint32_t laneState = state;
+		for (uint32_t k = 0; k < simd_width; k++)
+		{
+			laneState = laneState * MSVC_RAND_MUL + MSVC_RAND_INC;
+			lanes[k]  = laneState;
+		}
+
+		constexpr LcgJump jump = msvcRandJump(simd_width);
+
+		__m256i lcgState[4];
+		for (uint32_t v = 0; v < 4; v++)
+			lcgState[v] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(lanes + v * LANES));
+
+		const __m256i mul  = _mm256_set1_epi32(static_cast<int>(jump.mul));
+		const __m256i inc  = _mm256_set1_epi32(static_cast<int>(jump.inc));
+		const __m256i mask = _mm256_set1_epi32((0x7FFF >> shift) & 0xFF);
+		const __m128i bits = _mm_cvtsi32_si128(static_cast<int>(16 + shift));
+
+		// The packs interleave the 128 bit lanes, this restores the order of the 4 byte groups
+		const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+		for (std::size_t i = 0; i < simdCount; i += simd_width)
+		{
+			__m256i values[4];
+
+			for (uint32_t v = 0; v < 4; v++)
+			{
+				values[v]   = _mm256_and_si256(_mm256_srl_epi32(lcgState[v], bits), mask);
+				lcgState[v] = _mm256_add_epi32(_mm256_mullo_epi32(lcgState[v], mul), inc);
+			}
+
+			const __m256i packed = _mm256_packus_epi16(_mm256_packus_epi32(values[0], values[1]), _mm256_packus_epi32(values[2], values[3]));
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(pOut + i), _mm256_permutevar8x32_epi32(packed, order));
+		}
+
+		state = msvcRandJump(simdCount).apply(state);
+	}
+
+	msvcRandBytesPlain(state, pOut + simdCount, count - simdCount, shift);
+}
+#endif
+
+// --- Dispatcher ---
+
+using MsvcRandBytesFunction = void (*)(uint32_t &, uint8_t *, const std::size_t &, const uint32_t &);
+
+inline MsvcRandBytesFunction selectMsvcRandBytesFunc([[maybe_unused]] const simd::CpuFeatures &features)
+{
+#ifdef SIMD_MSVC_X86
+	if (features.avx2)
+		return msvcRandBytesAVX2;
+#endif
+
+	return msvcRandBytesPlain;
+}
+
+// XOR every stride-th byte of pData with the low byte of msvc_rand() >> shift, with the generator seeded by msvc_srand(seed).
+// Byte-identical to the loop over msvc_rand(), but neither reads nor changes the state of msvc_rand()
+inline void msvcRandXor(uint8_t *pData, const std::size_t &size, const uint32_t &seed, const uint32_t &shift = 0, const std::size_t &stride = 1)
+{
+	const MsvcRandBytesFunction randBytesFunc = detail::selectOnce<selectMsvcRandBytesFunc>();
+
+	constexpr std::size_t CHUNK_SIZE = 4096;
+
+	uint8_t keyStream[CHUNK_SIZE];
+	uint32_t state          = seed;
+	const std::size_t count = (size + stride - 1) / stride;
+
+	for (std::size_t i = 0; i < count; i += CHUNK_SIZE)
+	{
+		const std::size_t chunk = std::min(CHUNK_SIZE, count - i);
+
+		randBytesFunc(state, keyStream, chunk, shift);
+
+		if (stride == 1)
+			detail::xorKey(pData + i, keyStream, 0, chunk);
+		else
+		{
+			for (std::size_t j = 0; j < chunk; j++)
+				pData[(i + j) * stride] ^= keyStream[j];
+		}
+	}
+}
+
 struct RngData
 {
 	static constexpr uint32_t OUTER_VEC_LEN = 0x20;
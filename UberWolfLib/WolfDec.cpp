@@ -29,6 +29,7 @@
 #include "WolfDec.h"
 
 #include <DXLib/DXArchive.h>
+#include <DXLib/DXArchiveSink.h>
 #include <DXLib/DXArchiveVer5.h>
 #include <DXLib/DXArchiveVer6.h>
 #include <DXLib/FileLib.h>
@@ -36,12 +37,14 @@
 #include <nlohmann/json.hpp>
 
 #include <algorithm>
+#include <atomic>
 #include <codecvt>
 #include <filesystem>
 #include <format>
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <thread>
 #include <vector>
 #include <windows.h>
 
@@ -53,6 +56,7 @@ namespace fs = std::filesystem;
 
 static constexpr uint16_t PRO_CRYPT_VERSION = 1000;
 static constexpr uint16_t CC2_PRO_VERSION   = 0xC8;
+static constexpr uint32_t MAX_PROBE_THREADS = 4;
 
 const CryptModes DEFAULT_CRYPT_MODES = {
 	{ "Wolf RPG v2.01", 0x0, &DXArchive_VER5::DecodeArchive, &DXArchive_VER5::EncodeArchiveOneDirectory, std::vector<unsigned char>{ 0x0f, 0x53, 0xe1, 0x3e, 0x04, 0x37, 0x12, 0x17, 0x60, 0x0f, 0x53, 0xe1 } },
@@ -68,6 +72,44 @@ const CryptModes DEFAULT_CRYPT_MODES = {
 	{ "One Way Heroics Plus", 0x0, &DXArchive::DecodeArchive, &DXArchive::EncodeArchiveOneDirectoryWolf, "Ph=X3^]o2A(,1=@3#a" }
 };
 
+// Decrypt function of an archive version as named in the config file
+static DecryptFunction getDecryptFunction(std::string decoder)
+{
+	std::transform(decoder.begin(), decoder.end(), decoder.begin(), [](const unsigned char& c) { return std::tolower(c); });
+
+	if (decoder == "ver5")
+		return &DXArchive_VER5::DecodeArchive;
+	else if (decoder == "ver6")
+		return &DXArchive_VER6::DecodeArchive;
+	else if (decoder == "ver8")
+		return &DXArchive::DecodeArchive;
+
+	return nullptr;
+}
+
+static std::string getDecoderName(const DecryptFunction& decFunc)
+{
+	if (decFunc == &DXArchive_VER5::DecodeArchive)
+		return "VER5";
+	else if (decFunc == &DXArchive_VER6::DecodeArchive)
+		return "VER6";
+
+	return "VER8";
+}
+
+// Header-only probe for the archive format a decrypt function handles
+static ProbeFunction getProbeFunction(const DecryptFunction& decFunc)
+{
+	if (decFunc == &DXArchive_VER5::DecodeArchive)
+		return &DXArchive_VER5::ProbeArchive;
+	else if (decFunc == &DXArchive_VER6::DecodeArchive)
+		return &DXArchive_VER6::ProbeArchive;
+	else if (decFunc == &DXArchive::DecodeArchive)
+		return &DXArchive::ProbeArchive;
+
+	return nullptr;
+}
+
 WolfDec::WolfDec(const std::wstring& progName, const uint32_t& mode, const bool& isSubProcess) :
 	m_progName(progName),
 	m_mode(mode),
@@ -75,12 +117,24 @@ WolfDec::WolfDec(const std::wstring& progName, const uint32_t& mode, const bool&
 	m_valid(true)
 {
 	loadConfig();
+
+	if (!isSubProcess)
+	{
+		m_workerPool   = std::make_shared<WorkerPool>(progName, std::thread::hardware_concurrency());
+		m_archiveCache = std::make_shared<ArchiveCache>();
+	}
 }
 
 WolfDec::~WolfDec()
 {
 }
 
+void WolfDec::SetEntryFilters(const tStrings& include, const tStrings& exclude)
+{
+	m_includeFilters = include;
+	m_excludeFilters = exclude;
+}
+
 bool WolfDec::IsValidFile(const tString& filePath) const
 {
 	const tStrings specialFiles = GetSpecialFiles();
@@ -174,15 +228,6 @@ bool WolfDec::PackArchive(const tString& folderPath, const bool& override)
 
 bool WolfDec::UnpackArchive(const tString& filePath, const bool& override)
 {
-	TCHAR pFullPath[MAX_PATH];
-	const fs::path fp = fs::path(filePath);
-	const tString cwd = fs::current_path();
-
-	const tString directoryPath = fp.parent_path();
-	const tString fileName      = fp.stem();
-
-	ConvertFullPath__(filePath.c_str(), pFullPath);
-
 	// Check if the basename of the file is in the ignore list
 	if (!IsValidFile(filePath))
 		return true;
@@ -191,12 +236,32 @@ bool WolfDec::UnpackArchive(const tString& filePath, const bool& override)
 	if (!override && IsAlreadyUnpacked(filePath))
 		return true;
 
+	// A cached mode skips the detection, if the mode no longer fits the archive is detected again
+	bool cacheAdded = false;
+	if (m_mode == -1 && loadCachedMode(filePath, cacheAdded))
+	{
+		if (unpackMode(filePath, m_mode, override))
+			return true;
+
+		// Do not keep a mode that was only added for the failed cache entry
+		if (cacheAdded)
+			m_additionalModes.pop_back();
+
+		m_mode = -1;
+	}
+
 	if (m_mode == -1)
 	{
 		const uint16_t cryptVersion = getCryptVersion(filePath);
 
 		if (cryptVersion == 0x0)
-			return detectMode(filePath, override);
+		{
+			if (!detectMode(filePath, override))
+				return false;
+
+			storeCachedMode(filePath);
+			return true;
+		}
 		// For Pro Games always return false and let UberWolfLib calculate the key
 		else if (cryptVersion >= PRO_CRYPT_VERSION)
 			return false;
@@ -209,36 +274,71 @@ bool WolfDec::UnpackArchive(const tString& filePath, const bool& override)
 	if (m_mode >= (DEFAULT_CRYPT_MODES.size() + m_additionalModes.size()))
 	{
 		ERROR_LOG << std::format(TEXT("Specified Mode: {} out of range"), m_mode) << std::endl;
-		if (m_isSubProcess)
-			ExitProcess(1);
-		else
-			return false;
+		return false;
 	}
 
-	// Always run the unpacking in a subprocess
-	if (!m_isSubProcess)
-		return runProcess(filePath, m_mode, override);
+	if (!unpackMode(filePath, m_mode, override))
+		return false;
 
-	const CryptMode curMode = (m_mode < DEFAULT_CRYPT_MODES.size() ? DEFAULT_CRYPT_MODES.at(m_mode) : m_additionalModes.at(m_mode - DEFAULT_CRYPT_MODES.size()));
+	storeCachedMode(filePath);
+	return true;
+}
 
-	fs::current_path(directoryPath);
-	fs::create_directory(fileName);
-	fs::current_path(fileName);
+bool WolfDec::ListArchive(const tString& filePath, ArchiveEntries& entries)
+{
+	bool cacheAdded = false;
+	if (m_mode == -1 && loadCachedMode(filePath, cacheAdded))
+	{
+		if (listArchive(filePath, m_mode, entries))
+			return true;
 
-	const bool failed = curMode.decFunc(pFullPath, TEXT(""), curMode.key.data()) < 0;
+		if (cacheAdded)
+			m_additionalModes.pop_back();
 
-	if (failed)
+		m_mode = -1;
+	}
+
+	const uint32_t modeCount = static_cast<uint32_t>(DEFAULT_CRYPT_MODES.size() + m_additionalModes.size());
+
+	if (m_mode == -1)
 	{
-		fs::current_path(directoryPath);
-		fs::remove_all(fileName);
+		const uint16_t cryptVersion = getCryptVersion(filePath);
+
+		// Listing only decodes the header in-process, so without a crypt version simply try every mode
+		if (cryptVersion == 0x0)
+		{
+			for (uint32_t i = 0; i < modeCount; i++)
+			{
+				if (listArchive(filePath, i, entries))
+				{
+					m_mode = i;
+					storeCachedMode(filePath);
+					return true;
+				}
+			}
+
+			return false;
+		}
+		// For Pro Games always return false and let UberWolfLib calculate the key
+		else if (cryptVersion >= PRO_CRYPT_VERSION)
+			return false;
+		else if (cryptVersion == CC2_PRO_VERSION)
+			return false;
+		else if (!detectCrypt(filePath))
+			return false;
 	}
 
-	if (m_isSubProcess)
-		ExitProcess(failed);
+	if (m_mode >= modeCount)
+	{
+		ERROR_LOG << std::format(TEXT("Specified Mode: {} out of range"), m_mode) << std::endl;
+		return false;
+	}
 
-	fs::current_path(cwd);
+	if (!listArchive(filePath, m_mode, entries))
+		return false;
 
-	return !failed;
+	storeCachedMode(filePath);
+	return true;
 }
 
 void WolfDec::AddAndSetKey(const std::string& name, const uint16_t& cryptVersion, const bool& useOldDxArc, const Key& key)
@@ -293,16 +393,9 @@ void WolfDec::loadConfig()
 			{
 				if (value.contains("mode") && value.contains("key"))
 				{
-					std::string mode        = value["mode"];
-					DecryptFunction decFunc = nullptr;
-					std::transform(mode.begin(), mode.end(), mode.begin(), [](const unsigned char& c) { return std::tolower(c); });
-					if (mode == "ver5")
-						decFunc = &DXArchive_VER5::DecodeArchive;
-					else if (mode == "ver6")
-						decFunc = &DXArchive_VER6::DecodeArchive;
-					else if (mode == "ver8")
-						decFunc = &DXArchive::DecodeArchive;
-					else
+					const std::string mode        = value["mode"];
+					const DecryptFunction decFunc = getDecryptFunction(mode);
+					if (decFunc == nullptr)
 						throw std::runtime_error("Invalid mode: " + mode);
 
 					std::vector<unsigned char> key;
@@ -333,6 +426,50 @@ void WolfDec::loadConfig()
 	}
 }
 
+bool WolfDec::loadCachedMode(const tString& filePath, bool& added)
+{
+	added = false;
+
+	ArchiveCacheEntry entry;
+	if (!m_archiveCache || !m_archiveCache->Lookup(filePath, entry))
+		return false;
+
+	const DecryptFunction decFunc = getDecryptFunction(entry.decoder);
+	if (decFunc == nullptr)
+		return false;
+
+	const std::vector<char> key(entry.key.begin(), entry.key.end());
+	const uint32_t modeCount = static_cast<uint32_t>(DEFAULT_CRYPT_MODES.size() + m_additionalModes.size());
+
+	for (uint32_t i = 0; i < modeCount; i++)
+	{
+		const CryptMode& curMode = (i < DEFAULT_CRYPT_MODES.size() ? DEFAULT_CRYPT_MODES.at(i) : m_additionalModes.at(i - DEFAULT_CRYPT_MODES.size()));
+
+		if (curMode.decFunc == decFunc && curMode.key == key)
+		{
+			m_mode = i;
+			return true;
+		}
+	}
+
+	// Keys derived for Pro games are not known before the derivation, so add the cached key
+	m_additionalModes.push_back({ entry.name, entry.cryptVersion, decFunc, nullptr, entry.key });
+	m_mode = modeCount;
+	added  = true;
+
+	return true;
+}
+
+void WolfDec::storeCachedMode(const tString& filePath) const
+{
+	if (!m_archiveCache || m_mode == -1)
+		return;
+
+	const CryptMode& curMode = (m_mode < DEFAULT_CRYPT_MODES.size() ? DEFAULT_CRYPT_MODES.at(m_mode) : m_additionalModes.at(m_mode - DEFAULT_CRYPT_MODES.size()));
+
+	m_archiveCache->Store(filePath, { curMode.name, getDecoderName(curMode.decFunc), curMode.cryptVersion, Key(curMode.key.begin(), curMode.key.end()) });
+}
+
 bool WolfDec::detectCrypt(const tString& filePath)
 {
 	// Check if the file contains a crypt version in the header
@@ -365,69 +502,183 @@ bool WolfDec::detectCrypt(const tString& filePath)
 
 bool WolfDec::detectMode(const tString& filePath, const bool& override)
 {
-	bool success = false;
+	if (m_mode != -1)
+		return unpackMode(filePath, m_mode);
 
-	if (m_mode == -1)
+	std::vector<uint32_t> modes = probeModes(filePath);
+
+	// The probes of the old archive versions validate the whole entry table, which is stricter than their extraction
+	// in a few corner cases, so an archive no probe accepts still gets the sequential trial extraction of these modes.
+	// The probe of the current version decodes the header exactly like the extraction, retrying those modes can not succeed
+	if (modes.empty())
 	{
-		for (uint32_t i = 0; i < DEFAULT_CRYPT_MODES.size(); i++)
+		const uint32_t modeCount = static_cast<uint32_t>(DEFAULT_CRYPT_MODES.size() + m_additionalModes.size());
+
+		for (uint32_t i = 0; i < modeCount; i++)
 		{
-			success = runProcess(filePath, i, override);
-			if (success)
-			{
-				m_mode = i;
-				return success;
-			}
+			const CryptMode& curMode = (i < DEFAULT_CRYPT_MODES.size() ? DEFAULT_CRYPT_MODES.at(i) : m_additionalModes.at(i - DEFAULT_CRYPT_MODES.size()));
+
+			if (curMode.decFunc != &DXArchive::DecodeArchive)
+				modes.push_back(i);
 		}
+	}
 
-		for (uint32_t i = 0; i < m_additionalModes.size(); i++)
+	// Only the modes whose key decodes a well formed header are used for the actual extraction
+	for (const uint32_t& mode : modes)
+	{
+		if (unpackMode(filePath, mode, override))
 		{
-			success = runProcess(filePath, static_cast<uint32_t>(DEFAULT_CRYPT_MODES.size() + i), override);
-			if (success)
-			{
-				m_mode = static_cast<uint32_t>(DEFAULT_CRYPT_MODES.size() + i);
-				return success;
-			}
+			m_mode = mode;
+			return true;
 		}
 	}
-	else
-		success = runProcess(filePath, m_mode);
 
-	return success;
+	return false;
 }
 
-bool WolfDec::runProcess(const tString& filePath, const uint32_t& mode, const bool& override) const
+std::vector<uint32_t> WolfDec::probeModes(const tString& filePath) const
 {
-	STARTUPINFO si;
-	PROCESS_INFORMATION pi;
+	TCHAR pFullPath[MAX_PATH];
+	const uint32_t modeCount = static_cast<uint32_t>(DEFAULT_CRYPT_MODES.size() + m_additionalModes.size());
+
+	// Not std::vector<bool>, every thread writes its own element
+	std::vector<uint8_t> fits(modeCount, 0);
+	std::atomic<uint32_t> next = 0;
+	std::vector<std::thread> threads;
+
+	ConvertFullPath__(filePath.c_str(), pFullPath);
+
+	// Probing only decodes the header, so the modes are tried in-process on a few threads
+	const auto probe = [&]() {
+		for (uint32_t i = next++; i < modeCount; i = next++)
+		{
+			const CryptMode& curMode      = (i < DEFAULT_CRYPT_MODES.size() ? DEFAULT_CRYPT_MODES.at(i) : m_additionalModes.at(i - DEFAULT_CRYPT_MODES.size()));
+			const ProbeFunction probeFunc = getProbeFunction(curMode.decFunc);
+
+			// Modes without a probe have to be tried with a full extraction
+			fits[i] = (probeFunc == nullptr || probeFunc(pFullPath, curMode.key.data()) == 0);
+		}
+	};
+
+	const uint32_t threadCount = std::min<uint32_t>({ std::max(std::thread::hardware_concurrency(), 1u), MAX_PROBE_THREADS, modeCount });
 
-	ZeroMemory(&si, sizeof(si));
-	si.cb = sizeof(si);
-	ZeroMemory(&pi, sizeof(pi));
+	for (uint32_t i = 1; i < threadCount; i++)
+		threads.emplace_back(probe);
 
-	const std::wstring wstr = m_progName + L" -m " + std::to_wstring(mode) + L" \"" + std::wstring(filePath) + L"\"" + (override ? L" -o" : L"");
+	probe();
 
-	if (!CreateProcess(NULL, const_cast<LPWSTR>(wstr.c_str()), NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi))
+	for (std::thread& thread : threads)
+		thread.join();
+
+	// Keep the order of the modes, so the same mode wins as with the sequential trial extraction
+	std::vector<uint32_t> modes;
+	for (uint32_t i = 0; i < modeCount; i++)
 	{
-		ERROR_LOG << std::format(TEXT("CreateProcess() failed: {}"), GetLastError()) << std::endl;
-		return false;
+		if (fits[i])
+			modes.push_back(i);
 	}
 
-	// Wait until child process exits.
-	WaitForSingleObject(pi.hProcess, INFINITE);
+	return modes;
+}
+
+bool WolfDec::unpackMode(const tString& filePath, const uint32_t& mode, const bool& override) const
+{
+	const CryptMode& curMode = (mode < DEFAULT_CRYPT_MODES.size() ? DEFAULT_CRYPT_MODES.at(mode) : m_additionalModes.at(mode - DEFAULT_CRYPT_MODES.size()));
+
+	// The current archive version validates the header tables and bounds checks every decompression,
+	// so damaged or wrongly keyed archives fail cleanly and can be extracted in-process.
+	// The old archive versions are not hardened and still run in a crash-isolating subprocess
+	if (curMode.decFunc == &DXArchive::DecodeArchive)
+		return extractArchive(filePath, curMode);
+
+	if (!runProcess(filePath, curMode, override))
+		return false;
+
+	// The old archive versions have no entry selection, make clear that the filters did not apply
+	if (!m_includeFilters.empty() || !m_excludeFilters.empty())
+		ERROR_LOG << std::format(TEXT("The include/exclude filters are not supported for this archive version, all files of {} were extracted"), fs::path(filePath).filename().native()) << std::endl;
+
+	return true;
+}
+
+bool WolfDec::extractArchive(const tString& filePath, const CryptMode& curMode) const
+{
+	TCHAR pFullPath[MAX_PATH];
+
+	ConvertFullPath__(filePath.c_str(), pFullPath);
+
+	// Extract into an explicit output directory instead of changing the working directory of the process
+	const fs::path outputDir = fs::path(pFullPath).parent_path() / fs::path(filePath).stem();
+	fs::create_directory(outputDir);
+
+	int result;
 
-	bool success = false;
+	// The filters are passed with the call, so archives extracted at the same time can not change them for each other.
+	// The old archive versions always extract everything
+	if (curMode.decFunc == &DXArchive::DecodeArchive)
+	{
+		const DARC_DECODEOPTIONS options = { static_cast<int>(m_decodeThreadNum), m_includeFilters, m_excludeFilters };
+		DXArchiveFileSystemSink sink(outputDir.c_str());
 
-	DWORD ec;
-	if (FALSE == GetExitCodeProcess(pi.hProcess, &ec))
-		ERROR_LOG << std::format(TEXT("GetExitCodeProcess() failed: {}"), GetLastError()) << std::endl;
+		result = DXArchive::DecodeArchiveToSink(pFullPath, &sink, curMode.key.data(), &options);
+	}
 	else
-		success = (ec == 0);
+		result = curMode.decFunc(pFullPath, outputDir.c_str(), curMode.key.data());
+
+	const bool failed = result < 0;
+
+	if (failed)
+		fs::remove_all(outputDir);
+
+	return !failed;
+}
 
-	// Close process and thread handles.
-	CloseHandle(pi.hProcess);
-	CloseHandle(pi.hThread);
+bool WolfDec::runProcess(const tString& filePath, const CryptMode& curMode, const bool& override) const
+{
+	// The workers are started once and reused, so an attempt does not pay for a new process each time.
+	// The job carries the decoder and the key itself, a worker does not know the modes added after it was started
+	return m_workerPool->Run({ filePath, getDecoderName(curMode.decFunc), curMode.key, override });
+}
+
+void WolfDec::RunWorker(HANDLE jobPipe, HANDLE resultPipe)
+{
+	WorkerPool::Serve(jobPipe, resultPipe, [this](const WorkerJob& job) {
+		const DecryptFunction decFunc = getDecryptFunction(job.decoder);
+		if (decFunc == nullptr)
+		{
+			ERROR_LOG << std::format(TEXT("Invalid decoder: {}"), StringToWString(job.decoder)) << std::endl;
+			return false;
+		}
+
+		if (!job.override && IsAlreadyUnpacked(job.filePath))
+			return true;
+
+		return extractArchive(job.filePath, CryptMode(job.decoder, 0x0, decFunc, nullptr, job.key));
+	});
+}
+
+bool WolfDec::listArchive(const tString& filePath, const uint32_t& mode, ArchiveEntries& entries) const
+{
+	TCHAR pFullPath[MAX_PATH];
+	const CryptMode& curMode = (mode < DEFAULT_CRYPT_MODES.size() ? DEFAULT_CRYPT_MODES.at(mode) : m_additionalModes.at(mode - DEFAULT_CRYPT_MODES.size()));
+
+	// The old archive versions have no header-only entry point
+	if (curMode.decFunc != &DXArchive::DecodeArchive)
+		return false;
+
+	ConvertFullPath__(filePath.c_str(), pFullPath);
 
-	return success;
+	DARC_ARCHIVEMODEL model;
+	if (DXArchive::ListArchive(pFullPath, &model, curMode.key.data()) < 0)
+		return false;
+
+	entries.clear();
+	entries.reserve(model.Entries.size());
+
+	for (const DARC_ENTRY& entry : model.Entries)
+		entries.push_back({ DXArchive::GetEntryPath(&model, &entry), entry.Directory, entry.DataSize, entry.PressDataSize, entry.HuffPressDataSize, entry.DataPosition });
+
+	return true;
 }
 
 uint16_t WolfDec::getCryptVersion(const tString& filePath) const
@@ -29,14 +29,18 @@
 #include <cstdint>
 #include <exception>
 #include <iterator>
+#include <memory>
 #include <string>
 #include <tchar.h>
 #include <vector>
 
+#include "ArchiveCache.h"
 #include "Types.h"
+#include "WorkerPool.h"
 
 using DecryptFunction = int (*)(TCHAR*, const TCHAR*, const char*);
 using EncryptFunction = int (*)(const TCHAR*, const TCHAR*, bool, const char*, uint16_t);
+using ProbeFunction   = int (*)(TCHAR*, const char*);
 
 class InvalidModeException : public std::exception
 {};
@@ -80,14 +84,26 @@ struct CryptMode
 
 using CryptModes = std::vector<CryptMode>;
 
+struct ArchiveEntry
+{
+	tString path;
+	bool directory;
+	uint64_t size;
+	uint64_t pressSize;     // 0xFFFFFFFFFFFFFFFF if the entry is not LZ compressed
+	uint64_t huffPressSize; // 0xFFFFFFFFFFFFFFFF if the entry is not Huffman compressed
+	uint64_t offset;        // Absolute position of the entry data inside the archive
+};
+
+using ArchiveEntries = std::vector<ArchiveEntry>;
+
 class WolfDec
 {
 public:
 	inline static const std::string CONFIG_FILE_NAME = "UberWolfConfig.json";
 
 public:
-	WolfDec() :
-		WolfDec(L"") {}
+	// Placeholder until the real instance is assigned, neither loads the config nor creates the worker pool and the cache
+	WolfDec() = default;
 	WolfDec(const std::wstring& progName, const uint32_t& mode = -1, const bool& isSubProcess = false);
 	~WolfDec();
 
@@ -114,6 +130,11 @@ public:
 
 	bool UnpackArchive(const tString& filePath, const bool& override = false);
 
+	bool ListArchive(const tString& filePath, ArchiveEntries& entries);
+
+	// Worker side of the extraction worker pool, runs the jobs of the parent process until it closes the job pipe
+	void RunWorker(HANDLE jobPipe, HANDLE resultPipe);
+
 	void AddAndSetKey(const std::string& name, const uint16_t& cryptVersion, const bool& useOldDxArc, const Key& key);
 
 	void AddKey(const std::string& name, const uint16_t& cryptVersion, const bool& useOldDxArc, const Key& key);
@@ -123,15 +144,29 @@ public:
 		m_mode = -1;
 	}
 
+	void SetEntryFilters(const tStrings& include, const tStrings& exclude);
+
+	// Number of threads extracting the entries of a v8 archive ( 0: one per hardware thread )
+	void SetDecodeThreadNum(const uint32_t& threadNum)
+	{
+		m_decodeThreadNum = threadNum;
+	}
+
 	static tStrings GetEncryptionsW();
 	static Strings GetEncryptions();
 
 private:
 	void removeOldConfig() const;
 	void loadConfig();
+	bool loadCachedMode(const tString& filePath, bool& added);
+	void storeCachedMode(const tString& filePath) const;
 	bool detectCrypt(const tString& filePath);
 	bool detectMode(const tString& filePath, const bool& override = false);
-	bool runProcess(const tString& filePath, const uint32_t& mode, const bool& override = false) const;
+	std::vector<uint32_t> probeModes(const tString& filePath) const;
+	bool unpackMode(const tString& filePath, const uint32_t& mode, const bool& override = false) const;
+	bool extractArchive(const tString& filePath, const CryptMode& curMode) const;
+	bool runProcess(const tString& filePath, const CryptMode& curMode, const bool& override = false) const;
+	bool listArchive(const tString& filePath, const uint32_t& mode, ArchiveEntries& entries) const;
 
 	uint16_t getCryptVersion(const tString& filePath) const;
 
@@ -141,4 +176,9 @@ private:
 	std::wstring m_progName;
 	bool m_isSubProcess = false;
 	bool m_valid        = false;
+	tStrings m_includeFilters;
+	tStrings m_excludeFilters;
+	uint32_t m_decodeThreadNum = 0;
+	std::shared_ptr<WorkerPool> m_workerPool; // Shared by the copies of the instance, the workers are only started on the first job
+	std::shared_ptr<ArchiveCache> m_archiveCache;
 };
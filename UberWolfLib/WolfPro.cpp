@@ -304,10 +304,8 @@ Key WolfPro::findDxArcKeyV1(std::vector<uint8_t>& byteData, const uint32_t& file
 	Key key;
 	if (fileSize < DxArcKey::MIN_FILESIZE) return key;
 
-	srand(byteData[DxArcKey::SEED_OFFSET]);
-
-	for (std::size_t j = DxArcKey::XOR_START_OFFSET; j < byteData.size(); j++)
-		byteData[j] ^= static_cast<uint8_t>(rand() >> DxArcKey::SHIFT);
+	if (byteData.size() > DxArcKey::XOR_START_OFFSET)
+		wolf::crypt::rng::msvcRandXor(byteData.data() + DxArcKey::XOR_START_OFFSET, byteData.size() - DxArcKey::XOR_START_OFFSET, byteData[DxArcKey::SEED_OFFSET], DxArcKey::SHIFT);
 
 	uint8_t keyLen  = byteData[DxArcKey::KEY_LEN_OFFSET];
 	uint32_t steps  = DxArcKey::STEP_DIVISOR / keyLen;
@@ -574,10 +572,7 @@ std::vector<uint8_t> WolfPro::removeProtectionFromProject(const tString& filePat
 
 	if (!readFile(filePath, bytes, fileSize)) return bytes;
 
-	srand(seed);
-
-	for (uint8_t& byte : bytes)
-		byte ^= static_cast<uint8_t>(rand());
+	wolf::crypt::rng::msvcRandXor(bytes.data(), bytes.size(), seed);
 
 	return bytes;
 }
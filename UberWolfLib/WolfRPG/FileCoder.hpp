@@ -451,10 +451,7 @@ private:
 
 	void cryptProj(Bytes& data)
 	{
-		wolf::crypt::rng::msvc_srand(s_projKey);
-
-		for (uint8_t& byte : data)
-			byte ^= static_cast<uint8_t>(wolf::crypt::rng::msvc_rand());
+		wolf::crypt::rng::msvcRandXor(data.data(), data.size(), s_projKey);
 	}
 
 #ifdef _WIN32
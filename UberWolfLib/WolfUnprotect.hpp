@@ -86,9 +86,7 @@ void gameDatUpdateSize(std::vector<uint8_t> &bytes, const uint32_t &oldSize)
 void unprotectProject(std::vector<uint8_t> &projData)
 {
 	// ¯\_(ツ)_/¯ So far it looks like this is how it is done
-	srand(0);
-	for (uint8_t &byte : projData)
-		byte ^= static_cast<uint8_t>(rand());
+	wolf::crypt::rng::msvcRandXor(projData.data(), projData.size(), 0);
 }
 
 void unprotectProFiles(const std::filesystem::path &basicDataPath)
@@ -27,9 +27,14 @@
 #pragma once
 
 #include <bitset>
-#include <intrin.h>
 #include <iostream>
 
+// The CPU detection and the SIMD kernels use the MSVC intrinsics, other compilers and targets report no features and use the plain kernels
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define SIMD_MSVC_X86
+#include <intrin.h>
+#endif
+
 namespace simd
 {
 
@@ -41,6 +46,7 @@ struct CpuFeatures
 	bool ssse3    = false;
 	bool sse4_1   = false;
 	bool sse4_2   = false;
+	bool aes      = false;
 	bool avx      = false;
 	bool avx2     = false;
 	bool avx512f  = false;
@@ -58,6 +64,7 @@ struct CpuFeatures
 		out << "SSSE3:     " << yesno(ssse3) << std::endl;
 		out << "SSE4.1:    " << yesno(sse4_1) << std::endl;
 		out << "SSE4.2:    " << yesno(sse4_2) << std::endl;
+		out << "AES-NI:    " << yesno(aes) << std::endl;
 		out << "AVX:       " << yesno(avx) << std::endl;
 		out << "AVX2:      " << yesno(avx2) << std::endl;
 		out << "AVX-512F:  " << yesno(avx512f) << std::endl;
@@ -68,6 +75,7 @@ struct CpuFeatures
 	}
 };
 
+#ifdef SIMD_MSVC_X86
 [[nodiscard]]
 inline int cpuidMaxLeaf()
 {
@@ -88,10 +96,14 @@ inline bool osSupportsZmm()
 	return (_xgetbv(0) & 0xE6) == 0xE6;
 }
 
+#endif
+
 [[nodiscard]]
 inline CpuFeatures detectCpuFeatures()
 {
 	CpuFeatures features{};
+
+#ifdef SIMD_MSVC_X86
 	int cpuInfo[4];
 
 	if (cpuidMaxLeaf() < 1) return features;
@@ -106,6 +118,7 @@ inline CpuFeatures detectCpuFeatures()
 	features.ssse3  = ecx.test(9);
 	features.sse4_1 = ecx.test(19);
 	features.sse4_2 = ecx.test(20);
+	features.aes    = ecx.test(25);
 
 	bool osxsave       = ecx.test(27);
 	bool avx_supported = ecx.test(28);
@@ -136,6 +149,7 @@ inline CpuFeatures detectCpuFeatures()
 			}
 		}
 	}
+#endif
 
 	return features;
 }
@@ -0,0 +1,314 @@
+/*
+ *  File: WorkerPool.cpp
+ *  Copyright (c) 2025 Sinflower
+ *
+ *  MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ */
+
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <format>
+#include <string>
+
+#include "UberLog.h"
+
+// Time a worker gets to exit by itself after its job pipe was closed
+static constexpr DWORD WORKER_EXIT_TIMEOUT = 5000;
+
+static bool writeAll(HANDLE pipe, const void* pData, const std::size_t& size)
+{
+	const uint8_t* pBytes = static_cast<const uint8_t*>(pData);
+	std::size_t written   = 0;
+
+	while (written < size)
+	{
+		DWORD bytes = 0;
+		if (!WriteFile(pipe, pBytes + written, static_cast<DWORD>(std::min<std::size_t>(size - written, MAXDWORD)), &bytes, nullptr))
+			return false;
+
+		written += bytes;
+	}
+
+	return true;
+}
+
+// Fails when the other end of the pipe was closed, i.e., the process on the other side exited or crashed
+static bool readAll(HANDLE pipe, void* pData, const std::size_t& size)
+{
+	uint8_t* pBytes  = static_cast<uint8_t*>(pData);
+	std::size_t read = 0;
+
+	while (read < size)
+	{
+		DWORD bytes = 0;
+		if (!ReadFile(pipe, pBytes + read, static_cast<DWORD>(std::min<std::size_t>(size - read, MAXDWORD)), &bytes, nullptr) || bytes == 0)
+			return false;
+
+		read += bytes;
+	}
+
+	return true;
+}
+
+static void putU32(std::vector<uint8_t>& buffer, const uint32_t& value)
+{
+	const uint8_t* pBytes = reinterpret_cast<const uint8_t*>(&value);
+	buffer.insert(buffer.end(), pBytes, pBytes + sizeof(value));
+}
+
+static void putString(std::vector<uint8_t>& buffer, const tString& str)
+{
+	const uint8_t* pBytes = reinterpret_cast<const uint8_t*>(str.data());
+
+	putU32(buffer, static_cast<uint32_t>(str.size()));
+	buffer.insert(buffer.end(), pBytes, pBytes + str.size() * sizeof(TCHAR));
+}
+
+static void putBytes(std::vector<uint8_t>& buffer, const void* pData, const std::size_t& size)
+{
+	const uint8_t* pBytes = static_cast<const uint8_t*>(pData);
+
+	putU32(buffer, static_cast<uint32_t>(size));
+	buffer.insert(buffer.end(), pBytes, pBytes + size);
+}
+
+static bool readU32(HANDLE pipe, uint32_t& value)
+{
+	return readAll(pipe, &value, sizeof(value));
+}
+
+static bool readString(HANDLE pipe, tString& str)
+{
+	uint32_t length;
+	if (!readU32(pipe, length))
+		return false;
+
+	str.resize(length);
+	return readAll(pipe, str.data(), length * sizeof(TCHAR));
+}
+
+template<typename T>
+static bool readBytes(HANDLE pipe, T& bytes)
+{
+	uint32_t size;
+	if (!readU32(pipe, size))
+		return false;
+
+	bytes.resize(size);
+	return readAll(pipe, bytes.data(), size);
+}
+
+static bool readJob(HANDLE pipe, WorkerJob& job)
+{
+	uint32_t override;
+
+	if (!readString(pipe, job.filePath) || !readBytes(pipe, job.decoder) || !readBytes(pipe, job.key) || !readU32(pipe, override))
+		return false;
+
+	job.override = (override != 0);
+
+	return true;
+}
+
+WorkerPool::WorkerPool(const std::wstring& progName, const std::size_t& maxWorkers) :
+	m_progName(progName),
+	m_maxWorkers(std::max<std::size_t>(maxWorkers, 1))
+{
+}
+
+WorkerPool::~WorkerPool()
+{
+	// Closing the job pipes lets the workers leave their job loop and exit
+	for (Worker& worker : m_idle)
+		stopWorker(worker);
+}
+
+bool WorkerPool::Run(const WorkerJob& job)
+{
+	Worker worker;
+
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_cv.wait(lock, [this]() { return !m_idle.empty() || m_workerCount < m_maxWorkers; });
+
+		if (!m_idle.empty())
+		{
+			worker = m_idle.back();
+			m_idle.pop_back();
+		}
+		else
+			m_workerCount++;
+	}
+
+	// Workers are only started when there is no idle one, afterwards they stay alive for the next jobs
+	bool alive   = (worker.process != nullptr || startWorker(worker));
+	bool success = false;
+
+	if (alive)
+		alive = runJob(worker, job, success);
+
+	// A worker that crashed or could not be started is dropped, the next job starts a new one in its place
+	if (!alive && worker.process != nullptr)
+	{
+		ERROR_LOG << std::format(TEXT("Extraction worker exited while unpacking: {}"), job.filePath) << std::endl;
+		stopWorker(worker);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (alive)
+			m_idle.push_back(worker);
+		else
+			m_workerCount--;
+	}
+
+	m_cv.notify_one();
+
+	return success;
+}
+
+void WorkerPool::Serve(HANDLE jobPipe, HANDLE resultPipe, const WorkerJobHandler& handler)
+{
+	WorkerJob job;
+
+	while (readJob(jobPipe, job))
+	{
+		const uint8_t result = handler(job) ? 1 : 0;
+
+		if (!writeAll(resultPipe, &result, sizeof(result)))
+			break;
+	}
+
+	CloseHandle(jobPipe);
+	CloseHandle(resultPipe);
+}
+
+bool WorkerPool::startWorker(Worker& worker) const
+{
+	SECURITY_ATTRIBUTES sa = { sizeof(SECURITY_ATTRIBUTES), nullptr, TRUE };
+	HANDLE jobRead, jobWrite, resultRead, resultWrite;
+
+	if (!CreatePipe(&jobRead, &jobWrite, &sa, 0))
+	{
+		ERROR_LOG << std::format(TEXT("CreatePipe() failed: {}"), GetLastError()) << std::endl;
+		return false;
+	}
+
+	if (!CreatePipe(&resultRead, &resultWrite, &sa, 0))
+	{
+		ERROR_LOG << std::format(TEXT("CreatePipe() failed: {}"), GetLastError()) << std::endl;
+		CloseHandle(jobRead);
+		CloseHandle(jobWrite);
+		return false;
+	}
+
+	// Only the ends of the worker are inherited
+	SetHandleInformation(jobWrite, HANDLE_FLAG_INHERIT, 0);
+	SetHandleInformation(resultRead, HANDLE_FLAG_INHERIT, 0);
+
+	// Restrict the inheritance to these two handles, a worker holding the pipes of another worker
+	// open would keep the pipes of that worker from breaking when it crashes
+	HANDLE inherit[] = { jobRead, resultWrite };
+	SIZE_T attrSize  = 0;
+	InitializeProcThreadAttributeList(nullptr, 1, 0, &attrSize);
+
+	std::vector<uint8_t> attrBuffer(attrSize);
+	LPPROC_THREAD_ATTRIBUTE_LIST pAttrList = reinterpret_cast<LPPROC_THREAD_ATTRIBUTE_LIST>(attrBuffer.data());
+
+	bool success = InitializeProcThreadAttributeList(pAttrList, 1, 0, &attrSize);
+
+	if (success)
+		success = UpdateProcThreadAttribute(pAttrList, 0, PROC_THREAD_ATTRIBUTE_HANDLE_LIST, inherit, sizeof(inherit), nullptr, nullptr);
+
+	STARTUPINFOEX si;
+	PROCESS_INFORMATION pi;
+
+	ZeroMemory(&si, sizeof(si));
+	si.StartupInfo.cb = sizeof(si);
+	si.lpAttributeList = pAttrList;
+	ZeroMemory(&pi, sizeof(pi));
+
+	// The worker gets the values of the inherited handles on its command line
+	std::wstring wstr = m_progName + L" " + WORKER_ARG + L" " + std::to_wstring(reinterpret_cast<uintptr_t>(jobRead)) + L" " + std::to_wstring(reinterpret_cast<uintptr_t>(resultWrite));
+
+	if (success)
+	{
+		success = CreateProcess(NULL, const_cast<LPWSTR>(wstr.c_str()), NULL, NULL, TRUE, EXTENDED_STARTUPINFO_PRESENT, NULL, NULL, &si.StartupInfo, &pi);
+
+		if (!success)
+			ERROR_LOG << std::format(TEXT("CreateProcess() failed: {}"), GetLastError()) << std::endl;
+
+		DeleteProcThreadAttributeList(pAttrList);
+	}
+
+	// The worker holds its own copies now
+	CloseHandle(jobRead);
+	CloseHandle(resultWrite);
+
+	if (!success)
+	{
+		CloseHandle(jobWrite);
+		CloseHandle(resultRead);
+		return false;
+	}
+
+	CloseHandle(pi.hThread);
+
+	worker.process    = pi.hProcess;
+	worker.jobPipe    = jobWrite;
+	worker.resultPipe = resultRead;
+
+	return true;
+}
+
+void WorkerPool::stopWorker(Worker& worker)
+{
+	CloseHandle(worker.jobPipe);
+	CloseHandle(worker.resultPipe);
+
+	if (WaitForSingleObject(worker.process, WORKER_EXIT_TIMEOUT) == WAIT_TIMEOUT)
+		TerminateProcess(worker.process, 1);
+
+	CloseHandle(worker.process);
+
+	worker = Worker();
+}
+
+bool WorkerPool::runJob(Worker& worker, const WorkerJob& job, bool& success)
+{
+	std::vector<uint8_t> buffer;
+	uint8_t result;
+
+	putString(buffer, job.filePath);
+	putBytes(buffer, job.decoder.data(), job.decoder.size());
+	putBytes(buffer, job.key.data(), job.key.size());
+	putU32(buffer, job.override ? 1 : 0);
+
+	if (!writeAll(worker.jobPipe, buffer.data(), buffer.size()) || !readAll(worker.resultPipe, &result, sizeof(result)))
+		return false;
+
+	success = (result != 0);
+
+	return true;
+}
@@ -0,0 +1,92 @@
+/*
+ *  File: WorkerPool.h
+ *  Copyright (c) 2025 Sinflower
+ *
+ *  MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <windows.h>
+
+#include "Types.h"
+
+// Extraction job of a worker, the decoder and the key are sent instead of a mode index,
+// as the modes a worker loaded at start-up miss keys that were found or added afterwards
+// Workers only extract the old archive versions, which always extract all files, so no entry filters are sent
+struct WorkerJob
+{
+	tString filePath;
+	std::string decoder; // Decoder name as used in the config file, e.g., "VER6"
+	std::vector<char> key;
+	bool override;
+};
+
+using WorkerJobHandler = std::function<bool(const WorkerJob&)>;
+
+// Pool of sandboxed extraction processes, the processes are started once and then receive jobs over pipes,
+// so an extraction attempt does not pay for the process and library start-up.
+// A worker that crashes only fails its current job and is replaced by a new process on the next job
+class WorkerPool
+{
+public:
+	inline static const tString WORKER_ARG = TEXT("-w");
+
+public:
+	WorkerPool(const std::wstring& progName, const std::size_t& maxWorkers);
+	~WorkerPool();
+
+	WorkerPool(const WorkerPool&)            = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	// Run the job on an idle worker, waits if all workers are busy
+	bool Run(const WorkerJob& job);
+
+	// Worker side, run the jobs read from jobPipe and report the results to resultPipe until the pool closes the job pipe
+	static void Serve(HANDLE jobPipe, HANDLE resultPipe, const WorkerJobHandler& handler);
+
+private:
+	struct Worker
+	{
+		HANDLE process    = nullptr;
+		HANDLE jobPipe    = nullptr; // Write end, the worker reads the jobs from the other end
+		HANDLE resultPipe = nullptr; // Read end, the worker writes the results to the other end
+	};
+
+	bool startWorker(Worker& worker) const;
+	static void stopWorker(Worker& worker);
+	static bool runJob(Worker& worker, const WorkerJob& job, bool& success);
+
+private:
+	std::wstring m_progName;
+	std::size_t m_maxWorkers;
+	std::size_t m_workerCount = 0;
+	std::vector<Worker> m_idle;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+};